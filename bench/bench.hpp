@@ -0,0 +1,112 @@
+/**
+ * @file bench.hpp
+ *
+ * @brief
+ *  Minimal harness for the assertify micro-benchmarks. Each benchmark is a
+ *  function that runs a kernel a given number of times; the harness scales the
+ *  iteration count until one run lasts at least the minimum time, repeats the
+ *  run and reports the passing-path cost per check in nanoseconds together
+ *  with the machine code size of the kernel.
+ *
+ *  Kernels are compiled once per failure policy (see kernels.hpp) and register
+ *  themselves at static initialization.
+ */
+
+#ifndef ASSERTIFY_BENCH_HPP
+#define ASSERTIFY_BENCH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace bench
+{
+/**
+ * @brief
+ *  Forces `value` to be materialized in a register or in memory, so the
+ *  computation that produced it cannot be optimized away.
+ */
+template <class T>
+inline __attribute__((always_inline)) void do_not_optimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <class T>
+inline __attribute__((always_inline)) void do_not_optimize(T &value)
+{
+    // Register-sized values are pinned in a register: GCC may drop the store
+    // behind a "+m,r" operand in functions that call `setjmp`.
+    if constexpr (std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(void *))
+        asm volatile("" : "+r"(value) : : "memory");
+    else
+        asm volatile("" : "+m"(value) : : "memory");
+}
+
+/**
+ * @brief
+ *  Compiler barrier: all pending writes are assumed to be observed and all
+ *  memory is assumed to be modified, so loads cannot be hoisted across it.
+ */
+inline __attribute__((always_inline)) void clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+/** Number of elements returned by `values()`. */
+constexpr std::size_t value_count = 1024;
+
+namespace detail
+{
+    constexpr std::array<int, value_count> make_values()
+    {
+        std::array<int, value_count> v{};
+        for (std::size_t i = 0; i < value_count; ++i)
+            v[i] = static_cast<int>(i);
+        return v;
+    }
+
+    inline constexpr std::array<int, value_count> g_values = make_values();
+} // namespace detail
+
+/**
+ * @brief
+ *  Returns the ascending sequence 0, 1, ..., value_count - 1 through a pointer
+ *  the optimizer cannot see through, so checks on it are not folded away.
+ */
+inline __attribute__((always_inline)) const int *values()
+{
+    const int *p = detail::g_values.data();
+    do_not_optimize(p);
+    return p;
+}
+
+/** A kernel run `iterations` times; each iteration performs `checks` assertions. */
+using kernel = void (*)(std::size_t iterations);
+
+struct benchmark
+{
+    /** Failure policy the kernel was compiled with, e.g. "abort". */
+    const char *policy;
+    /** Check shape, e.g. "hot_loop". */
+    const char *shape;
+    kernel fn;
+    /** Assertions evaluated per iteration. */
+    std::size_t checks;
+};
+
+inline std::vector<benchmark> &registry()
+{
+    static std::vector<benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct registrar
+{
+    explicit registrar(const benchmark &b) { registry().push_back(b); }
+};
+} // namespace bench
+
+#endif /* ASSERTIFY_BENCH_HPP */
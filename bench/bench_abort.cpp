@@ -0,0 +1,14 @@
+/**
+ * @file bench_abort.cpp
+ *
+ * @brief
+ *  `ASSERT_ABORT`: report and abort on failure.
+ */
+
+#include "assertify.hpp"
+
+#define BENCH_POLICY policy_abort
+#define BENCH_POLICY_NAME "abort"
+#define BENCH_ASSERT(expr, msg) ASSERT_ABORT(expr, msg)
+
+#include "kernels.hpp"
@@ -0,0 +1,15 @@
+/**
+ * @file bench_exception.cpp
+ *
+ * @brief
+ *  `ASSERTIFY_ASSERT_EXCEPTION` in its default form: throw `AssertionError`
+ *  and catch it at the assertion site.
+ */
+
+#include "assertify.hpp"
+
+#define BENCH_POLICY policy_exception
+#define BENCH_POLICY_NAME "exception"
+#define BENCH_ASSERT(expr, msg) ASSERTIFY_ASSERT_EXCEPTION(expr, msg)
+
+#include "kernels.hpp"
@@ -0,0 +1,17 @@
+/**
+ * @file bench_long_jump.cpp
+ *
+ * @brief
+ *  `ASSERTIFY_ASSERT_EXCEPTION` with ASSERTIFY_LONG_JMP_ENDABLED: `setjmp` at
+ *  every check, `longjmp` back to it on failure.
+ */
+
+#define ASSERTIFY_LONG_JMP_ENDABLED
+#include "assertify.hpp"
+
+#define BENCH_POLICY policy_long_jump
+#define BENCH_POLICY_NAME "long_jump"
+#define BENCH_ASSERT(expr, msg) ASSERTIFY_ASSERT_EXCEPTION(expr, msg)
+#define BENCH_LOCAL volatile
+
+#include "kernels.hpp"
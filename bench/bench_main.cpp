@@ -0,0 +1,320 @@
+/**
+ * @file bench_main.cpp
+ *
+ * @brief
+ *  Runs the registered benchmarks and reports, per failure policy and check
+ *  shape, the passing-path cost in nanoseconds per check and the code size of
+ *  the kernel. Results are printed as a table and optionally written as JSON.
+ *  With --perf, one more pass of each kernel runs inside an
+ *  `assertify::perf_scope` and its counters are reported per check.
+ *
+ *  usage: assertify-bench [--filter TEXT] [--min-time-ms MS] [--repetitions N]
+ *                         [--warmup-ms MS] [--cpu N] [--perf] [--json FILE]
+ */
+
+#include "assertify.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <link.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace
+{
+    struct options
+    {
+        std::string filter;
+        double min_time_ms = 100;
+        std::size_t repetitions = 10;
+        double warmup_ms = 10;
+        int cpu = -1;
+        bool perf = false;
+        std::string json_path;
+    };
+
+    struct result
+    {
+        const bench::benchmark *b;
+        std::size_t iterations;
+        std::vector<double> samples;
+        double min, median, max;
+        std::size_t code_size;
+        assertify::perf_counters counters;
+    };
+
+    /** Policies in the order they are reported, cheapest first. */
+    constexpr const char *policy_order[] = {"none", "abort", "exception", "long_jump"};
+
+    std::size_t policy_rank(const char *policy)
+    {
+        auto it = std::find_if(std::begin(policy_order), std::end(policy_order),
+                               [&](const char *p) { return std::strcmp(p, policy) == 0; });
+        return static_cast<std::size_t>(it - std::begin(policy_order));
+    }
+
+    std::string name(const bench::benchmark &b)
+    {
+        return std::string(b.policy) + "/" + b.shape;
+    }
+
+    /** Size in bytes of the function at `fn`, from the dynamic symbol table, or 0. */
+    std::size_t code_size(bench::kernel fn)
+    {
+#if defined(__GLIBC__)
+        Dl_info info;
+        void *sym = nullptr;
+        if (dladdr1(reinterpret_cast<void *>(fn), &info, &sym, RTLD_DL_SYMENT) != 0 &&
+            sym != nullptr)
+            return static_cast<const ElfW(Sym) *>(sym)->st_size;
+#endif
+        (void)fn;
+        return 0;
+    }
+
+    double elapsed_ns(const bench::benchmark &b, std::size_t iterations)
+    {
+        auto start = std::chrono::steady_clock::now();
+        b.fn(iterations);
+        auto stop = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+
+    /** Doubles the iteration count until one run lasts a tenth of the minimum time, then scales it up. */
+    std::size_t calibrate(const bench::benchmark &b, double min_time_ns)
+    {
+        std::size_t iterations = 1;
+        for (;;)
+        {
+            double ns = elapsed_ns(b, iterations);
+            if (ns >= min_time_ns / 10 || iterations >= (std::size_t(1) << 40))
+                return std::max<std::size_t>(
+                    1, static_cast<std::size_t>(static_cast<double>(iterations) * min_time_ns / ns));
+            iterations *= 2;
+        }
+    }
+
+    /** Runs the kernel until `warmup_ns` have passed, so caches and branch predictors are hot. */
+    void warm_up(const bench::benchmark &b, double warmup_ns)
+    {
+        double spent = 0;
+        for (std::size_t iterations = 1; spent < warmup_ns;
+             iterations = std::min<std::size_t>(iterations * 2, std::size_t(1) << 20))
+            spent += elapsed_ns(b, iterations);
+    }
+
+    /** Pins the process to `cpu`, so every sample runs on the same core. */
+    bool pin_to_cpu(int cpu)
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return ::sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpu;
+        return false;
+#endif
+    }
+
+    result run(const bench::benchmark &b, const options &opts)
+    {
+        warm_up(b, opts.warmup_ms * 1e6);
+        result r{&b, calibrate(b, opts.min_time_ms * 1e6), {}, 0, 0, 0, code_size(b.fn), {}};
+        for (std::size_t i = 0; i < opts.repetitions; ++i)
+            r.samples.push_back(elapsed_ns(b, r.iterations) /
+                                static_cast<double>(r.iterations * b.checks));
+        if (opts.perf)
+        {
+            // Counted in a pass of its own, so reading the counters does not skew the samples
+            assertify::perf_scope scope;
+            b.fn(r.iterations);
+            r.counters = scope.elapsed();
+        }
+        std::vector<double> sorted = r.samples;
+        std::sort(sorted.begin(), sorted.end());
+        r.min = sorted.front();
+        r.max = sorted.back();
+        std::size_t mid = sorted.size() / 2;
+        r.median = sorted.size() % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+        return r;
+    }
+
+    /** Counter `c` of the perf pass, per check. */
+    double per_check(const result &r, std::size_t c)
+    {
+        return static_cast<double>(r.counters.values[c]) /
+               static_cast<double>(r.iterations * r.b->checks);
+    }
+
+    void print_perf(const std::vector<result> &results)
+    {
+        std::uint32_t available = ~std::uint32_t(0);
+        for (const result &r : results)
+            available &= r.counters.available;
+        assertify::perf_source source = results.front().counters.source;
+        std::cout << "\nper check, counted by "
+                  << assertify::perf_source_names[static_cast<unsigned>(source)] << " events\n"
+                  << std::left << std::setw(32) << "benchmark" << std::right;
+        for (std::size_t c = 0; c < assertify::perf_counter_count; ++c)
+            if ((available >> c) & 1)
+                std::cout << std::setw(18) << assertify::perf_counter_names[c];
+        std::cout << "\n";
+        for (const result &r : results)
+        {
+            std::cout << std::left << std::setw(32) << name(*r.b) << std::right << std::fixed
+                      << std::setprecision(4);
+            for (std::size_t c = 0; c < assertify::perf_counter_count; ++c)
+                if ((available >> c) & 1)
+                    std::cout << std::setw(18) << per_check(r, c);
+            std::cout << "\n";
+        }
+    }
+
+    std::string timestamp()
+    {
+        std::time_t now = std::time(nullptr);
+        char text[32];
+        std::strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        return text;
+    }
+
+    void write_json(std::ostream &out, const std::vector<result> &results, const options &opts)
+    {
+        out << std::setprecision(6);
+        out << "{\n  \"context\": {\n"
+            << "    \"date\": \"" << timestamp() << "\",\n"
+#if defined(__VERSION__)
+            << "    \"compiler\": \"" << __VERSION__ << "\",\n"
+#endif
+#if defined(__OPTIMIZE__)
+            << "    \"optimized\": true,\n"
+#else
+            << "    \"optimized\": false,\n"
+#endif
+            << "    \"cpus\": " << std::thread::hardware_concurrency() << ",\n"
+            << "    \"min_time_ms\": " << opts.min_time_ms << ",\n"
+            << "    \"repetitions\": " << opts.repetitions << ",\n"
+            << "    \"warmup_ms\": " << opts.warmup_ms << ",\n"
+            << "    \"cpu\": " << opts.cpu << ",\n"
+            << "    \"unit\": \"ns\"\n  },\n  \"benchmarks\": [";
+        for (std::size_t i = 0; i < results.size(); ++i)
+        {
+            const result &r = results[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << name(*r.b) << "\", \"policy\": \""
+                << r.b->policy << "\", \"shape\": \"" << r.b->shape
+                << "\", \"checks_per_iteration\": " << r.b->checks
+                << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": {\"min\": " << r.min
+                << ", \"median\": " << r.median << ", \"max\": " << r.max << "}, \"samples\": [";
+            for (std::size_t j = 0; j < r.samples.size(); ++j)
+                out << (j ? ", " : "") << r.samples[j];
+            out << "], \"code_size\": ";
+            if (r.code_size != 0)
+                out << r.code_size;
+            else
+                out << "null";
+            if (opts.perf)
+            {
+                out << ", \"perf\": {\"source\": \""
+                    << assertify::perf_source_names[static_cast<unsigned>(r.counters.source)]
+                    << "\"";
+                for (std::size_t c = 0; c < assertify::perf_counter_count; ++c)
+                    if ((r.counters.available >> c) & 1)
+                        out << ", \"" << assertify::perf_counter_names[c]
+                            << "\": " << per_check(r, c);
+                out << "}";
+            }
+            out << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            opts.filter = argv[++i];
+        else if (arg == "--min-time-ms" && i + 1 < argc)
+            opts.min_time_ms = std::atof(argv[++i]);
+        else if (arg == "--repetitions" && i + 1 < argc)
+            opts.repetitions = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--warmup-ms" && i + 1 < argc)
+            opts.warmup_ms = std::atof(argv[++i]);
+        else if (arg == "--cpu" && i + 1 < argc)
+            opts.cpu = std::atoi(argv[++i]);
+        else if (arg == "--perf")
+            opts.perf = true;
+        else if (arg == "--json" && i + 1 < argc)
+            opts.json_path = argv[++i];
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--filter TEXT] [--min-time-ms MS] [--repetitions N]"
+                         " [--warmup-ms MS] [--cpu N] [--perf] [--json FILE]\n";
+            return 2;
+        }
+    }
+    if (opts.cpu >= 0 && !pin_to_cpu(opts.cpu))
+    {
+        std::cerr << "cannot pin to cpu " << opts.cpu << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::vector<const bench::benchmark *> selected;
+    for (const bench::benchmark &b : bench::registry())
+        if (name(b).find(opts.filter) != std::string::npos)
+            selected.push_back(&b);
+    std::sort(selected.begin(), selected.end(),
+              [](const bench::benchmark *a, const bench::benchmark *b) {
+                  int shape = std::strcmp(a->shape, b->shape);
+                  return shape != 0 ? shape < 0 : policy_rank(a->policy) < policy_rank(b->policy);
+              });
+
+    std::vector<result> results;
+    std::cout << std::left << std::setw(32) << "benchmark" << std::right << std::setw(12)
+              << "ns/check" << std::setw(12) << "min" << std::setw(12) << "max" << std::setw(12)
+              << "code size" << "\n";
+    for (const bench::benchmark *b : selected)
+    {
+        results.push_back(run(*b, opts));
+        const result &r = results.back();
+        std::cout << std::left << std::setw(32) << name(*b) << std::right << std::fixed
+                  << std::setprecision(3) << std::setw(12) << r.median << std::setw(12) << r.min
+                  << std::setw(12) << r.max << std::setw(12) << r.code_size << std::endl;
+    }
+
+    if (opts.perf && !results.empty())
+        print_perf(results);
+
+    if (!opts.json_path.empty())
+    {
+        std::ofstream out(opts.json_path);
+        write_json(out, results, opts);
+        if (!out)
+        {
+            std::cerr << opts.json_path << ": cannot write results\n";
+            return 1;
+        }
+    }
+    return 0;
+}
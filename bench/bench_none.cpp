@@ -0,0 +1,14 @@
+/**
+ * @file bench_none.cpp
+ *
+ * @brief
+ *  Baseline: the predicate is evaluated and kept alive, but never branched on.
+ */
+
+#include "bench.hpp"
+
+#define BENCH_POLICY policy_none
+#define BENCH_POLICY_NAME "none"
+#define BENCH_ASSERT(expr, msg) ::bench::do_not_optimize(static_cast<bool>(expr))
+
+#include "kernels.hpp"
@@ -0,0 +1,94 @@
+/**
+ * @file kernels.hpp
+ *
+ * @brief
+ *  Benchmark kernels, included once per failure policy. The including file
+ *  defines:
+ *
+ *  - `BENCH_POLICY`: namespace the kernels are placed in, so each policy gets
+ *    its own exported symbols and code size,
+ *  - `BENCH_POLICY_NAME`: policy name written to the results,
+ *  - `BENCH_ASSERT(expr, msg)`: the assertion under test,
+ *
+ *  and may define `BENCH_LOCAL` as the qualifier of the locals that live
+ *  across a check: `volatile` for a policy that calls `setjmp` at every
+ *  check, so `longjmp` cannot clobber them. The loops step their counters
+ *  with plain assignments, which C++20 still allows on volatile variables.
+ *
+ *  Every check passes; the kernels measure only the passing path.
+ */
+
+#include "bench.hpp"
+
+#include <algorithm>
+
+#ifndef BENCH_LOCAL
+#define BENCH_LOCAL
+#endif
+
+namespace bench
+{
+namespace BENCH_POLICY
+{
+    /** One check per element of a tight loop that would otherwise vectorize. */
+    __attribute__((noinline)) void hot_loop(std::size_t iterations)
+    {
+        BENCH_LOCAL std::size_t n = 0;
+        while (n < iterations)
+        {
+            const int *v = values();
+            BENCH_LOCAL int sum = 0;
+            BENCH_LOCAL std::size_t i = 0;
+            while (i < value_count)
+            {
+                BENCH_ASSERT(v[i] >= 0, "values are non-negative");
+                sum = sum + v[i];
+                i = i + 1;
+            }
+            do_not_optimize(static_cast<int>(sum));
+            n = n + 1;
+        }
+    }
+
+    /** One check whose predicate walks 64 elements; the branch is noise next to it. */
+    __attribute__((noinline)) void expensive_predicate(std::size_t iterations)
+    {
+        BENCH_LOCAL std::size_t n = 0;
+        while (n < iterations)
+        {
+            const int *v = values();
+            BENCH_ASSERT(std::is_sorted(v, v + 64), "values are sorted");
+            clobber_memory();
+            n = n + 1;
+        }
+    }
+
+#define BENCH_SITE(i) BENCH_ASSERT(v[i] == i, "values are their index");
+#define BENCH_SITES_8(i)                                                                   \
+    BENCH_SITE(i) BENCH_SITE(i + 1) BENCH_SITE(i + 2) BENCH_SITE(i + 3) BENCH_SITE(i + 4) \
+    BENCH_SITE(i + 5) BENCH_SITE(i + 6) BENCH_SITE(i + 7)
+
+    /** 64 distinct assertion sites in straight-line code: measures code size and i-cache pressure. */
+    __attribute__((noinline)) void many_sites(std::size_t iterations)
+    {
+        BENCH_LOCAL std::size_t n = 0;
+        while (n < iterations)
+        {
+            const int *v = values();
+            BENCH_SITES_8(0) BENCH_SITES_8(8) BENCH_SITES_8(16) BENCH_SITES_8(24)
+            BENCH_SITES_8(32) BENCH_SITES_8(40) BENCH_SITES_8(48) BENCH_SITES_8(56)
+            clobber_memory();
+            n = n + 1;
+        }
+    }
+
+#undef BENCH_SITES_8
+#undef BENCH_SITE
+
+    const registrar registrars[] = {
+        registrar({BENCH_POLICY_NAME, "hot_loop", hot_loop, value_count}),
+        registrar({BENCH_POLICY_NAME, "expensive_predicate", expensive_predicate, 1}),
+        registrar({BENCH_POLICY_NAME, "many_sites", many_sites, 64}),
+    };
+} // namespace BENCH_POLICY
+} // namespace bench
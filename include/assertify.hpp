@@ -18,6 +18,3478 @@
 #define ASSERTIFY_HPP_o0y1k2
 
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#endif
+
+#if defined(__ELF__) && defined(__has_include)
+#if __has_include(<link.h>)
+#include <link.h>
+#define ASSERTIFY_HAS_EHDR_START
+
+// Provided by the linker: the ELF header of the main executable, mapped at
+// its load address.
+extern "C" const ElfW(Ehdr) __ehdr_start __attribute__((weak, visibility("hidden")));
+#endif
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#define ASSERTIFY_HAS_PERF_EVENT
+#endif
+#endif
+
+#if defined(ASSERTIFY_STACKTRACE_ENABLED)
+#include <unwind.h>
+#endif
+
+#include <chrono>
+#include <vector>
+
+// The background threads of the trace writer, the statistics exporter and the
+// expectation flusher need the threading headers; on other platforms those
+// features are no-ops and the remaining locks spin.
+#if defined(__unix__) || defined(__APPLE__)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#define ASSERTIFY_HAS_THREADS
+#endif
+
+#if defined(ASSERTIFY_TRACE_ENABLED) && defined(ASSERTIFY_HAS_THREADS)
+#define ASSERTIFY_TRACING
+#endif
+
+#if defined(__cpp_consteval)
+#define ASSERTIFY_CONSTEVAL consteval
+#else
+#define ASSERTIFY_CONSTEVAL constexpr
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ASSERTIFY_COLD __attribute__((cold, noinline))
+#else
+#define ASSERTIFY_COLD
+#endif
+
+/**
+ * @brief
+ *  Size of the stack buffer that `ASSERTIFY_ASSERT_FMT` formats its message
+ *  into. Longer messages are truncated and terminated with "...".
+ */
+#ifndef ASSERTIFY_FMT_BUFFER_SIZE
+#define ASSERTIFY_FMT_BUFFER_SIZE 256
+#endif
+
+/**
+ * @brief
+ *  Size of the stack buffer in which `__Assert` assembles its failure report
+ *  before writing it out. Longer reports are truncated.
+ */
+#ifndef ASSERTIFY_REPORT_BUFFER_SIZE
+#define ASSERTIFY_REPORT_BUFFER_SIZE 1024
+#endif
+
+/**
+ * @brief
+ *  Directory prefix, with a trailing separator, that is removed from
+ *  `__FILE__` at compile time before the name is stored at an assertion site.
+ *  The CMake `assertify` target sets it to the project source directory, so
+ *  reports and `.rodata` only contain project-relative paths.
+ */
+#ifndef ASSERTIFY_SOURCE_ROOT
+#define ASSERTIFY_SOURCE_ROOT ""
+#endif
+
+/**
+ * @brief
+ *  Maximum number of return addresses printed after a failure report when
+ *  `ASSERTIFY_STACKTRACE_ENABLED` is defined.
+ */
+#ifndef ASSERTIFY_STACKTRACE_DEPTH
+#define ASSERTIFY_STACKTRACE_DEPTH 64
+#endif
+
+/**
+ * @brief
+ *  Interval, in milliseconds, at which `assertify::start_stats_export`
+ *  publishes the per-site counters by default.
+ */
+#ifndef ASSERTIFY_STATS_INTERVAL_MS
+#define ASSERTIFY_STATS_INTERVAL_MS 100
+#endif
+
+/**
+ * @brief
+ *  Token bucket applied to each `ASSERTIFY_CHECK` site: up to
+ *  `ASSERTIFY_RATE_LIMIT_BURST` reports at once, then one report per
+ *  `ASSERTIFY_RATE_LIMIT_INTERVAL_MS`. Failures in between are counted and
+ *  summarized in the next report.
+ */
+#ifndef ASSERTIFY_RATE_LIMIT_BURST
+#define ASSERTIFY_RATE_LIMIT_BURST 10
+#endif
+
+#ifndef ASSERTIFY_RATE_LIMIT_INTERVAL_MS
+#define ASSERTIFY_RATE_LIMIT_INTERVAL_MS 1000
+#endif
+
+/**
+ * @brief
+ *  Socket path of the local failure collector, `assertify-collectord`.
+ */
+#ifndef ASSERTIFY_COLLECTOR_SOCKET
+#define ASSERTIFY_COLLECTOR_SOCKET "/tmp/assertify-collector.sock"
+#endif
+
+/**
+ * @brief
+ *  Default number of records in a crash ring opened with
+ *  `assertify::open_crash_ring`.
+ */
+#ifndef ASSERTIFY_CRASH_RING_CAPACITY
+#define ASSERTIFY_CRASH_RING_CAPACITY 64
+#endif
+
+/**
+ * @brief
+ *  Number of failure records each thread can hold for `ASSERTIFY_EXPECT`
+ *  before they are drained. Must be a power of two. Failures recorded while
+ *  the buffer is full are dropped and counted.
+ */
+#ifndef ASSERTIFY_EXPECT_BUFFER_SIZE
+#define ASSERTIFY_EXPECT_BUFFER_SIZE 256
+#endif
+
+/**
+ * @brief
+ *  Profiler settings for `ASSERTIFY_PROFILE_ENABLED`: counter shards per
+ *  site, and the number of sites in the table printed at exit.
+ */
+#ifndef ASSERTIFY_PROFILE_SHARDS
+#define ASSERTIFY_PROFILE_SHARDS 8
+#endif
+
+#ifndef ASSERTIFY_PROFILE_TOP
+#define ASSERTIFY_PROFILE_TOP 20
+#endif
+
+/**
+ * @brief
+ *  Trace settings for `ASSERTIFY_TRACE_ENABLED`: events each thread can hold
+ *  between flushes (a power of two), the shortest evaluation worth an event,
+ *  and the default flush interval of `assertify::start_trace`.
+ */
+#ifndef ASSERTIFY_TRACE_BUFFER_SIZE
+#define ASSERTIFY_TRACE_BUFFER_SIZE 4096
+#endif
+
+#ifndef ASSERTIFY_TRACE_MIN_NS
+#define ASSERTIFY_TRACE_MIN_NS 1000
+#endif
+
+#ifndef ASSERTIFY_TRACE_FLUSH_INTERVAL_MS
+#define ASSERTIFY_TRACE_FLUSH_INTERVAL_MS 100
+#endif
+
+/**
+ * @brief
+ *  Number of passing assertion sites each thread remembers with
+ *  `ASSERTIFY_BREADCRUMBS_ENABLED`, dumped with a fatal failure report. Must
+ *  be a power of two.
+ */
+#ifndef ASSERTIFY_BREADCRUMB_DEPTH
+#define ASSERTIFY_BREADCRUMB_DEPTH 16
+#endif
+
+/**
+ * @brief
+ *  Size of the buffer in which `assertify::flush_expectations` batches
+ *  failure records before writing them to the sink.
+ */
+#ifndef ASSERTIFY_SINK_BUFFER_SIZE
+#define ASSERTIFY_SINK_BUFFER_SIZE 16384
+#endif
+
+/**
+ * @brief
+ *  Interval, in milliseconds, at which `assertify::start_expect_flusher`
+ *  drains and reports soft assertion failures by default.
+ */
+#ifndef ASSERTIFY_EXPECT_FLUSH_INTERVAL_MS
+#define ASSERTIFY_EXPECT_FLUSH_INTERVAL_MS 1000
+#endif
+
+namespace assertify
+{
+namespace detail
+{
+    /**
+     * @brief
+     *  Appends text to a caller-provided buffer and never writes past its end.
+     *  Once full, the tail of the buffer is replaced with "..." to mark the
+     *  truncation.
+     */
+    class fixed_writer
+    {
+    public:
+        fixed_writer(char *buf, std::size_t cap) : m_buf(buf), m_cap(cap) {}
+
+        void append(const char *s, std::size_t n)
+        {
+            if (m_truncated)
+                return;
+            std::size_t room = m_cap - 1 - m_len;
+            if (n > room)
+            {
+                n = room;
+                m_truncated = true;
+            }
+            for (std::size_t i = 0; i < n; ++i)
+                m_buf[m_len + i] = s[i];
+            m_len += n;
+        }
+
+        void append(char c) { append(&c, 1); }
+
+        void append(std::string_view sv) { append(sv.data(), sv.size()); }
+
+        /** Null-terminates the buffer and returns the length written. */
+        std::size_t finish()
+        {
+            if (m_truncated && m_cap > 4)
+            {
+                m_len = m_cap - 1;
+                m_buf[m_len - 3] = m_buf[m_len - 2] = m_buf[m_len - 1] = '.';
+            }
+            m_buf[m_len] = '\0';
+            return m_len;
+        }
+
+        bool truncated() const { return m_truncated; }
+
+    private:
+        char *m_buf;
+        std::size_t m_cap;
+        std::size_t m_len = 0;
+        bool m_truncated = false;
+    };
+
+    /**
+     * @brief
+     *  A string of `N` characters held by value, so it can be built by
+     *  constant evaluation and stored as a single static array.
+     */
+    template <std::size_t N>
+    struct static_string
+    {
+        char chars[N + 1] = {};
+
+        constexpr const char *data() const { return chars; }
+        constexpr std::size_t size() const { return N; }
+    };
+
+    template <std::size_t N>
+    constexpr static_string<N - 1> make_static_string(const char (&s)[N])
+    {
+        static_string<N - 1> out;
+        for (std::size_t i = 0; i < N - 1; ++i)
+            out.chars[i] = s[i];
+        return out;
+    }
+
+    template <std::size_t... Ns>
+    constexpr static_string<(Ns + ... + 0)> concat(const static_string<Ns> &...parts)
+    {
+        static_string<(Ns + ... + 0)> out;
+        std::size_t pos = 0;
+        ((void)[&] {
+            for (std::size_t i = 0; i < parts.size(); ++i)
+                out.chars[pos++] = parts.chars[i];
+        }(), ...);
+        return out;
+    }
+
+    constexpr std::size_t count_digits(unsigned long value)
+    {
+        std::size_t n = 1;
+        while (value >= 10)
+            value /= 10, ++n;
+        return n;
+    }
+
+    /** Decimal representation of `Value`, computed at compile time. */
+    template <unsigned long Value>
+    constexpr static_string<count_digits(Value)> to_static_string()
+    {
+        static_string<count_digits(Value)> out;
+        unsigned long v = Value;
+        for (std::size_t i = out.size(); i > 0; --i, v /= 10)
+            out.chars[i - 1] = static_cast<char>('0' + v % 10);
+        return out;
+    }
+
+    /**
+     * @brief
+     *  Length of `file` once `ASSERTIFY_SOURCE_ROOT` has been removed from its
+     *  front. Paths outside the source root are kept whole.
+     */
+    template <std::size_t N>
+    ASSERTIFY_CONSTEVAL std::size_t trimmed_path_size(const char (&file)[N])
+    {
+        constexpr std::size_t root_size = sizeof(ASSERTIFY_SOURCE_ROOT) - 1;
+        if (N - 1 < root_size)
+            return N - 1;
+        for (std::size_t i = 0; i < root_size; ++i)
+        {
+            if (file[i] != ASSERTIFY_SOURCE_ROOT[i])
+                return N - 1;
+        }
+        return N - 1 - root_size;
+    }
+
+    /**
+     * @brief
+     *  `file` without its `ASSERTIFY_SOURCE_ROOT` prefix. `Size` must be
+     *  `trimmed_path_size(file)`; only the result ends up in the binary, the
+     *  full `__FILE__` literal is consumed by constant evaluation.
+     */
+    template <std::size_t Size, std::size_t N>
+    ASSERTIFY_CONSTEVAL static_string<Size> trim_path(const char (&file)[N])
+    {
+        static_string<Size> out;
+        for (std::size_t i = 0; i < Size; ++i)
+            out.chars[i] = file[N - 1 - Size + i];
+        return out;
+    }
+
+    /**
+     * @brief
+     *  The first `Size` characters of `msg`. If that cuts the message short,
+     *  the last three become "...", as in a report truncated at run time.
+     */
+    template <std::size_t Size, std::size_t M>
+    constexpr static_string<Size> shorten(const char (&msg)[M])
+    {
+        static_string<Size> out;
+        for (std::size_t i = 0; i < Size; ++i)
+            out.chars[i] = Size < M - 1 && i + 3 >= Size ? '.' : msg[i];
+        return out;
+    }
+
+    /**
+     * @brief
+     *  Builds the complete failure report printed by `__Assert` at compile
+     *  time, for sites whose message, expression, file and line are all
+     *  literals. The report fits `ASSERTIFY_REPORT_BUFFER_SIZE`: a message
+     *  too long for it is shortened, so the expression and source lines are
+     *  always kept.
+     */
+    template <unsigned long Line, std::size_t M, std::size_t E, std::size_t F>
+    constexpr auto make_report(const char (&msg)[M], const char (&expr_str)[E],
+                               const static_string<F> &file)
+    {
+        constexpr std::size_t fixed = sizeof("Assert failed:\t") - 1 + sizeof("\nExpected:\t") - 1 +
+                                      (E - 1) + sizeof("\nSource:\t\t") - 1 + F +
+                                      sizeof(", Line: ") - 1 + count_digits(Line) + 1;
+        static_assert(fixed + 3 <= ASSERTIFY_REPORT_BUFFER_SIZE,
+                      "expression and source location exceed ASSERTIFY_REPORT_BUFFER_SIZE");
+        constexpr std::size_t room = ASSERTIFY_REPORT_BUFFER_SIZE - fixed;
+        return concat(make_static_string("Assert failed:\t"), shorten<(M - 1 < room ? M - 1 : room)>(msg),
+                      make_static_string("\nExpected:\t"), make_static_string(expr_str),
+                      make_static_string("\nSource:\t\t"), file,
+                      make_static_string(", Line: "), to_static_string<Line>(),
+                      make_static_string("\n"));
+    }
+
+    /**
+     * @brief
+     *  Writes a complete report to stderr, or to `fd`. On POSIX systems this
+     *  is a single `write(2)` call (repeated only for partial writes), which
+     *  bypasses the stdio and iostream state of a process that may already be
+     *  corrupted.
+     */
+    inline void write_report(const char *report, std::size_t size, int fd = 2)
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, report, size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return;
+            }
+            report += n;
+            size -= static_cast<std::size_t>(n);
+        }
+#else
+        (void)fd;
+        std::fwrite(report, 1, size, stderr);
+        std::fflush(stderr);
+#endif
+    }
+
+    template <class T>
+    void append_decimal(fixed_writer &out, T value)
+    {
+        char tmp[24];
+        auto end = std::to_chars(tmp, tmp + sizeof(tmp), value).ptr;
+        out.append(tmp, static_cast<std::size_t>(end - tmp));
+    }
+
+    template <class T>
+    void append_hex(fixed_writer &out, T value)
+    {
+        char tmp[2 + 2 * sizeof(T)] = {'0', 'x'};
+        auto res = std::to_chars(tmp + 2, tmp + sizeof(tmp), value, 16);
+        out.append(tmp, static_cast<std::size_t>(res.ptr - tmp));
+    }
+
+    /** Identity of the main executable, for offline symbolization. */
+    struct module_info
+    {
+        std::uintptr_t base = 0;
+        unsigned char build_id[32] = {};
+        std::size_t build_id_size = 0;
+    };
+
+#if defined(ASSERTIFY_STACKTRACE_ENABLED)
+    struct stack_capture
+    {
+        void **frames;
+        std::size_t max;
+        std::size_t skip;
+        std::size_t count;
+    };
+
+    inline _Unwind_Reason_Code unwind_frame(_Unwind_Context *ctx, void *arg)
+    {
+        auto *cap = static_cast<stack_capture *>(arg);
+        std::uintptr_t ip = _Unwind_GetIP(ctx);
+        if (ip == 0 || cap->count == cap->max)
+            return _URC_END_OF_STACK;
+        if (cap->skip > 0)
+            --cap->skip;
+        else
+            cap->frames[cap->count++] = reinterpret_cast<void *>(ip);
+        return _URC_NO_REASON;
+    }
+
+    /**
+     * @brief
+     *  Stores up to `max` return addresses of the calling thread, innermost
+     *  first, starting `skip` frames above the caller. Does not allocate and
+     *  does not symbolize.
+     */
+    __attribute__((noinline)) inline std::size_t capture_stack(void **frames, std::size_t max,
+                                                               std::size_t skip)
+    {
+        stack_capture cap{frames, max, skip + 1, 0};
+        _Unwind_Backtrace(&unwind_frame, &cap);
+        return cap.count;
+    }
+
+#else
+    inline std::size_t capture_stack(void **, std::size_t, std::size_t) { return 0; }
+#endif // ASSERTIFY_STACKTRACE_ENABLED
+
+    /**
+     * @brief
+     *  Reads the load address and GNU build-id of the main executable from its
+     *  mapped program headers. No system calls or allocation are involved.
+     */
+    inline module_info main_module()
+    {
+        module_info info;
+#if defined(ASSERTIFY_HAS_EHDR_START)
+        if (&__ehdr_start == nullptr)
+            return info;
+
+        const char *image = reinterpret_cast<const char *>(&__ehdr_start);
+        const auto *phdrs = reinterpret_cast<const ElfW(Phdr) *>(image + __ehdr_start.e_phoff);
+        for (std::size_t i = 0; i < __ehdr_start.e_phnum; ++i)
+        {
+            if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_offset == 0)
+            {
+                info.base = reinterpret_cast<std::uintptr_t>(image) - phdrs[i].p_vaddr;
+                break;
+            }
+        }
+
+        for (std::size_t i = 0; i < __ehdr_start.e_phnum; ++i)
+        {
+            if (phdrs[i].p_type != PT_NOTE)
+                continue;
+            const char *note = reinterpret_cast<const char *>(info.base + phdrs[i].p_vaddr);
+            const char *end = note + phdrs[i].p_memsz;
+            while (note + sizeof(ElfW(Nhdr)) <= end)
+            {
+                const auto *nhdr = reinterpret_cast<const ElfW(Nhdr) *>(note);
+                const char *name = note + sizeof(ElfW(Nhdr));
+                const char *desc = name + ((nhdr->n_namesz + 3) & ~3u);
+                if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                    std::string_view(name, 3) == "GNU")
+                {
+                    std::size_t size = nhdr->n_descsz;
+                    if (size > sizeof(info.build_id))
+                        size = sizeof(info.build_id);
+                    for (std::size_t b = 0; b < size; ++b)
+                        info.build_id[b] = static_cast<unsigned char>(desc[b]);
+                    info.build_id_size = size;
+                    return info;
+                }
+                note = desc + ((nhdr->n_descsz + 3) & ~3u);
+            }
+        }
+#endif
+        return info;
+    }
+
+    inline void append_build_id(fixed_writer &out, const module_info &module)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        for (std::size_t i = 0; i < module.build_id_size; ++i)
+        {
+            out.append(digits[module.build_id[i] >> 4]);
+            out.append(digits[module.build_id[i] & 0xf]);
+        }
+    }
+
+    /**
+     * @brief
+     *  Formats raw return addresses together with the build-id and load base
+     *  of the main executable, in the form read by `tools/assertify-symbolize`.
+     *  Symbols are not resolved in the failing process, where that is slow and
+     *  may deadlock:
+     *
+     *  @code
+     *  Stack trace:    build-id 4f1c..., base 0x55d0c0a4b000
+     *          #0 0x55d0c0a4c1a2
+     *  @endcode
+     */
+    inline std::size_t format_stacktrace(char *buf, std::size_t cap, const module_info &module,
+                                         void *const *frames, std::size_t count)
+    {
+        fixed_writer out(buf, cap);
+        out.append("Stack trace:\tbuild-id ");
+        if (module.build_id_size == 0)
+            out.append("none");
+        append_build_id(out, module);
+        out.append(", base ");
+        append_hex(out, module.base);
+        out.append('\n');
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            char index[8];
+            auto res = std::to_chars(index, index + sizeof(index), i);
+            out.append("\t\t#");
+            out.append(index, static_cast<std::size_t>(res.ptr - index));
+            out.append(' ');
+            append_hex(out, reinterpret_cast<std::uintptr_t>(frames[i]));
+            out.append('\n');
+        }
+        return out.finish();
+    }
+
+    /**
+     * @brief
+     *  Stable 32-bit identifier of an assertion site: FNV-1a over the
+     *  (trimmed) file name and the line number.
+     */
+    constexpr std::uint32_t site_id(std::string_view file, int line)
+    {
+        std::uint32_t hash = 2166136261u;
+        for (char c : file)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+        for (int i = 0; i < 4; ++i)
+            hash = (hash ^ ((static_cast<std::uint32_t>(line) >> (8 * i)) & 0xff)) * 16777619u;
+        return hash;
+    }
+
+    /** Description of one failed assertion, passed along the failure path. */
+    struct failure
+    {
+        const char *expr_str;
+        const char *file;
+        int line;
+        const char *msg;
+        /** Raw bytes of the captured operands, if any. */
+        const void *operands = nullptr;
+        std::size_t operand_size = 0;
+    };
+
+    /**
+     * @brief
+     *  Formats the text report for `f` into `buf`, starting with `title`.
+     * @return Number of characters written, excluding the terminating null.
+     */
+    inline std::size_t format_report(char *buf, std::size_t cap, std::string_view title,
+                                     const failure &f)
+    {
+        char line_str[16];
+        auto line_end = std::to_chars(line_str, line_str + sizeof(line_str), f.line).ptr;
+
+        fixed_writer out(buf, cap);
+        out.append(title);
+        out.append(f.msg != nullptr ? f.msg : "");
+        out.append("\nExpected:\t");
+        out.append(f.expr_str);
+        out.append("\nSource:\t\t");
+        out.append(f.file);
+        out.append(", Line: ");
+        out.append(std::string_view(line_str, static_cast<std::size_t>(line_end - line_str)));
+        out.append('\n');
+        return out.finish();
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  One failure in a crash ring. The layout is the file format read by
+ *  `tools/assertify-ring` and must only change together with
+ *  `crash_ring_header::version`.
+ */
+struct crash_record
+{
+    /** Ring position plus one, stored last; 0 while the record is written. */
+    std::atomic<std::uint64_t> sequence;
+    /** `CLOCK_REALTIME` in nanoseconds. */
+    std::uint64_t timestamp_ns;
+    std::uint64_t thread_id;
+    std::uint32_t site_id;
+    std::int32_t line;
+    std::uint32_t operand_size;
+    std::uint32_t frame_count;
+    char file[64];
+    char expr_str[88];
+    char msg[128];
+    unsigned char operands[64];
+    std::uint64_t frames[16];
+};
+
+/** Start of a crash ring file, followed by `capacity` records. */
+struct crash_ring_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint32_t capacity;
+    std::uint32_t pid;
+    /** Total number of records ever claimed; slot is `next % capacity`. */
+    std::atomic<std::uint64_t> next;
+    std::uint64_t load_base;
+    std::uint32_t build_id_size;
+    unsigned char build_id[32];
+    std::uint32_t reserved[13];
+};
+
+static_assert(sizeof(crash_record) == 512, "crash_record is part of a file format");
+static_assert(sizeof(crash_ring_header) == 128, "crash_ring_header is part of a file format");
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "crash ring records are written with lock-free atomics");
+
+inline constexpr char crash_ring_magic[8] = {'A', 'S', 'R', 'T', 'R', 'I', 'N', 'G'};
+inline constexpr std::uint32_t crash_ring_version = 1;
+
+namespace detail
+{
+    inline std::atomic<crash_ring_header *> g_crash_ring{nullptr};
+
+    inline std::uint64_t thread_id()
+    {
+#if defined(__linux__)
+        return static_cast<std::uint64_t>(::syscall(SYS_gettid));
+#else
+        return 0;
+#endif
+    }
+
+    inline std::uint64_t realtime_ns()
+    {
+#if defined(__linux__)
+        timespec ts;
+        ::clock_gettime(CLOCK_REALTIME, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u +
+               static_cast<std::uint64_t>(ts.tv_nsec);
+#else
+        return 0;
+#endif
+    }
+
+#if defined(__linux__)
+    /** Formats `/dev/shm/<prefix><pid>` into `buf`. */
+    inline const char *default_shm_path(char *buf, std::size_t cap, std::string_view prefix)
+    {
+        char pid[16];
+        auto end = std::to_chars(pid, pid + sizeof(pid), ::getpid()).ptr;
+        fixed_writer out(buf, cap);
+        out.append("/dev/shm/");
+        out.append(prefix);
+        out.append(pid, static_cast<std::size_t>(end - pid));
+        out.finish();
+        return buf;
+    }
+#endif
+
+    /** Cheap monotonic clock in nanoseconds, with scheduler-tick resolution. */
+    inline std::uint64_t coarse_monotonic_ns()
+    {
+#if defined(__linux__)
+        timespec ts;
+        ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u +
+               static_cast<std::uint64_t>(ts.tv_nsec);
+#else
+        return static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+#endif
+    }
+
+    inline void copy_string(char *dst, std::size_t cap, const char *src)
+    {
+        fixed_writer out(dst, cap);
+        if (src != nullptr)
+            out.append(src);
+        out.finish();
+    }
+
+    /**
+     * @brief
+     *  Appends `f` to the crash ring, if one is open. Uses plain stores into
+     *  the shared mapping only, so the record survives the process dying
+     *  right afterwards.
+     */
+    inline void record_crash(const failure &f, void *const *frames, std::size_t count)
+    {
+        crash_ring_header *ring = g_crash_ring.load(std::memory_order_acquire);
+        if (ring == nullptr)
+            return;
+
+        std::uint64_t position = ring->next.fetch_add(1, std::memory_order_relaxed);
+        auto *records = reinterpret_cast<crash_record *>(ring + 1);
+        crash_record &rec = records[position % ring->capacity];
+
+        rec.sequence.store(0, std::memory_order_relaxed);
+        rec.timestamp_ns = realtime_ns();
+        rec.thread_id = thread_id();
+        rec.site_id = site_id(f.file, f.line);
+        rec.line = f.line;
+        copy_string(rec.file, sizeof(rec.file), f.file);
+        copy_string(rec.expr_str, sizeof(rec.expr_str), f.expr_str);
+        copy_string(rec.msg, sizeof(rec.msg), f.msg);
+
+        std::size_t operand_size = f.operand_size < sizeof(rec.operands) ? f.operand_size
+                                                                          : sizeof(rec.operands);
+        for (std::size_t i = 0; i < operand_size; ++i)
+            rec.operands[i] = static_cast<const unsigned char *>(f.operands)[i];
+        rec.operand_size = static_cast<std::uint32_t>(operand_size);
+
+        std::size_t frame_count = count < 16 ? count : 16;
+        for (std::size_t i = 0; i < frame_count; ++i)
+            rec.frames[i] = reinterpret_cast<std::uintptr_t>(frames[i]);
+        rec.frame_count = static_cast<std::uint32_t>(frame_count);
+
+        rec.sequence.store(position + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief
+     *  Hash of the stack addresses relative to the load base, so the same call
+     *  path hashes equally in every process running the same binary.
+     */
+    inline std::uint64_t stack_hash(void *const *frames, std::size_t count)
+    {
+        std::uintptr_t base = count > 0 ? main_module().base : 0;
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::uint64_t pc = reinterpret_cast<std::uintptr_t>(frames[i]) - base;
+            for (int b = 0; b < 8; ++b)
+                hash = (hash ^ ((pc >> (8 * b)) & 0xff)) * 1099511628211ull;
+        }
+        return hash;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Fixed part of a failure datagram sent to `assertify-collectord`. It is
+ *  followed by the file, expression and message, each null-terminated.
+ */
+struct collector_header
+{
+    std::uint32_t magic;
+    std::uint16_t version;
+    std::uint16_t flags;
+    std::uint32_t pid;
+    std::uint32_t site_id;
+    std::uint64_t thread_id;
+    std::uint64_t timestamp_ns;
+    std::uint64_t stack_hash;
+    std::int32_t line;
+    /** Datagrams this process dropped so far because the socket was full. */
+    std::uint32_t dropped;
+};
+
+static_assert(sizeof(collector_header) == 48, "collector_header is part of a wire format");
+
+inline constexpr std::uint32_t collector_magic = 0x54525341; // "ASRT"
+inline constexpr std::uint16_t collector_version = 1;
+inline constexpr std::size_t collector_datagram_size = 512;
+
+/** A decoded failure datagram. The strings point into the received buffer. */
+struct collector_message
+{
+    collector_header header;
+    std::string_view file;
+    std::string_view expr_str;
+    std::string_view msg;
+};
+
+/**
+ * @brief
+ *  Decodes a datagram received from a failing process.
+ * @return `false` if `data` is not a failure datagram of this version.
+ */
+inline bool decode_collector_message(const void *data, std::size_t size, collector_message &out)
+{
+    if (size < sizeof(collector_header))
+        return false;
+    const char *bytes = static_cast<const char *>(data);
+    for (std::size_t i = 0; i < sizeof(collector_header); ++i)
+        reinterpret_cast<char *>(&out.header)[i] = bytes[i];
+    if (out.header.magic != collector_magic || out.header.version != collector_version)
+        return false;
+
+    std::string_view rest(bytes + sizeof(collector_header), size - sizeof(collector_header));
+    std::string_view *fields[] = {&out.file, &out.expr_str, &out.msg};
+    for (std::string_view *field : fields)
+    {
+        std::size_t end = rest.find('\0');
+        if (end == std::string_view::npos)
+            return false;
+        *field = rest.substr(0, end);
+        rest.remove_prefix(end + 1);
+    }
+    return true;
+}
+
+namespace detail
+{
+    inline std::atomic<int> g_collector_fd{-1};
+    inline std::atomic<std::uint32_t> g_collector_dropped{0};
+
+    inline std::size_t encode_collector_message(char *buf, const failure &f,
+                                                void *const *frames, std::size_t count)
+    {
+        collector_header header{};
+        header.magic = collector_magic;
+        header.version = collector_version;
+#if defined(__linux__)
+        header.pid = static_cast<std::uint32_t>(::getpid());
+#endif
+        header.site_id = site_id(f.file, f.line);
+        header.thread_id = thread_id();
+        header.timestamp_ns = realtime_ns();
+        header.stack_hash = stack_hash(frames, count);
+        header.line = f.line;
+        header.dropped = g_collector_dropped.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < sizeof(header); ++i)
+            buf[i] = reinterpret_cast<const char *>(&header)[i];
+
+        std::size_t size = sizeof(header);
+        const char *fields[] = {f.file, f.expr_str, f.msg};
+        const std::size_t caps[] = {96, 128, collector_datagram_size - sizeof(header) - 96 - 128};
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            fixed_writer out(buf + size, caps[i]);
+            out.append(fields[i] != nullptr ? fields[i] : "");
+            size += out.finish() + 1;
+        }
+        return size;
+    }
+
+    /**
+     * @brief
+     *  Sends `f` to the collector, if connected. Never blocks: when the socket
+     *  buffer is full the datagram is dropped and counted instead.
+     */
+    inline void send_to_collector(const failure &f, void *const *frames, std::size_t count)
+    {
+#if defined(__linux__)
+        int fd = g_collector_fd.load(std::memory_order_acquire);
+        if (fd < 0)
+            return;
+        char buf[collector_datagram_size];
+        std::size_t size = encode_collector_message(buf, f, frames, count);
+        if (::send(fd, buf, size, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+            g_collector_dropped.fetch_add(1, std::memory_order_relaxed);
+#else
+        (void)f;
+        (void)frames;
+        (void)count;
+#endif
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Connects failure reporting to a local `assertify-collectord` over an
+ *  `AF_UNIX` datagram socket. Every fatal failure is then also sent as a
+ *  compact binary datagram. Sending never blocks the failing thread.
+ *
+ * @return `false` if the socket could not be created or no collector is
+ *  listening on `path`.
+ */
+inline bool connect_collector(const char *path = ASSERTIFY_COLLECTOR_SOCKET)
+{
+#if defined(__linux__)
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (std::string_view(path).size() >= sizeof(addr.sun_path))
+        return false;
+    detail::copy_string(addr.sun_path, sizeof(addr.sun_path), path);
+
+    int fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    int previous = detail::g_collector_fd.exchange(fd);
+    if (previous >= 0)
+        ::close(previous);
+    return true;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+/** Number of failure datagrams dropped because the collector socket was full. */
+inline std::uint32_t collector_dropped()
+{
+    return detail::g_collector_dropped.load(std::memory_order_relaxed);
+}
+
+#if defined(ASSERTIFY_BREADCRUMBS_ENABLED)
+
+/** One passing assertion recorded with `ASSERTIFY_BREADCRUMBS_ENABLED`. */
+struct breadcrumb
+{
+    std::uint32_t site_id;
+    /** Time stamp counter when the site passed, see `detail::read_tsc`. */
+    std::uint64_t tsc;
+};
+
+/**
+ * @brief
+ *  Constant description of an assertion site. With
+ *  `ASSERTIFY_BREADCRUMBS_ENABLED` defined every site registers one in the
+ *  `assertify_sites` linker section, so breadcrumbs can be resolved by ID.
+ */
+struct alignas(32) site_info
+{
+    std::uint32_t id;
+    int line;
+    const char *expr_str;
+    const char *file;
+};
+
+} // namespace assertify
+
+// Provided by the linker for the section that holds the site descriptions.
+extern "C" const assertify::site_info __start_assertify_sites[] __attribute__((weak, visibility("hidden")));
+extern "C" const assertify::site_info __stop_assertify_sites[] __attribute__((weak, visibility("hidden")));
+
+namespace assertify
+{
+namespace detail
+{
+    static_assert((ASSERTIFY_BREADCRUMB_DEPTH & (ASSERTIFY_BREADCRUMB_DEPTH - 1)) == 0,
+                  "ASSERTIFY_BREADCRUMB_DEPTH must be a power of two");
+
+    // File names and expressions of breadcrumbs are cut to this length.
+    inline constexpr std::size_t breadcrumb_field_max = 96;
+    inline constexpr std::size_t breadcrumb_text_size =
+        96 + ASSERTIFY_BREADCRUMB_DEPTH * (64 + 2 * breadcrumb_field_max);
+    inline constexpr std::size_t breadcrumb_json_size = 32 + ASSERTIFY_BREADCRUMB_DEPTH * 56;
+
+    /**
+     * @brief
+     *  Reads the CPU time stamp counter, or the virtual counter on AArch64.
+     *  Elsewhere falls back to the coarse monotonic clock.
+     */
+    inline std::uint64_t read_tsc()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+        std::uint64_t value;
+        asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+        return value;
+#else
+        return coarse_monotonic_ns();
+#endif
+    }
+
+    struct breadcrumb_ring
+    {
+        std::uint32_t next;
+        breadcrumb entries[ASSERTIFY_BREADCRUMB_DEPTH];
+    };
+
+    inline thread_local breadcrumb_ring t_breadcrumbs;
+
+    /** Records a pass of site `id`: two stores and one increment. */
+    inline bool leave_breadcrumb(std::uint32_t id, bool result)
+    {
+        if (result)
+        {
+            breadcrumb &slot = t_breadcrumbs.entries[t_breadcrumbs.next++ &
+                                                     (ASSERTIFY_BREADCRUMB_DEPTH - 1)];
+            slot.site_id = id;
+            slot.tsc = read_tsc();
+        }
+        return result;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Copies up to `max` breadcrumbs of the calling thread into `out`, most
+ *  recent first.
+ * @return Number of breadcrumbs copied.
+ */
+inline std::size_t recent_breadcrumbs(breadcrumb *out, std::size_t max)
+{
+    const detail::breadcrumb_ring &ring = detail::t_breadcrumbs;
+    std::size_t count = ring.next < ASSERTIFY_BREADCRUMB_DEPTH ? ring.next
+                                                               : ASSERTIFY_BREADCRUMB_DEPTH;
+    if (count > max)
+        count = max;
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] = ring.entries[(ring.next - 1 - i) & (ASSERTIFY_BREADCRUMB_DEPTH - 1)];
+    return count;
+}
+
+/**
+ * @brief
+ *  Looks up the description of a site registered by
+ *  `ASSERTIFY_BREADCRUMBS_ENABLED`.
+ * @return `nullptr` if no registered site has this ID.
+ */
+inline const site_info *find_site(std::uint32_t id)
+{
+    if (__start_assertify_sites == nullptr)
+        return nullptr;
+    for (const site_info *site = __start_assertify_sites; site != __stop_assertify_sites; ++site)
+    {
+        if (site->id == id)
+            return site;
+    }
+    return nullptr;
+}
+
+namespace detail
+{
+    /**
+     * @brief
+     *  Formats the breadcrumbs of the calling thread, most recent first, with
+     *  their distance in ticks from now:
+     *
+     *  @code
+     *  Breadcrumbs:    2 passing assertions before the failure, most recent first
+     *          #0 1520 ticks before  src/a.cpp:12  n < cap
+     *          #1 8830 ticks before  site 0x1f2e3d4c
+     *  @endcode
+     */
+    inline std::size_t format_breadcrumbs(char *buf, std::size_t cap)
+    {
+        breadcrumb crumbs[ASSERTIFY_BREADCRUMB_DEPTH];
+        std::size_t count = recent_breadcrumbs(crumbs, ASSERTIFY_BREADCRUMB_DEPTH);
+        if (count == 0)
+            return 0;
+
+        std::uint64_t now = read_tsc();
+        fixed_writer out(buf, cap);
+        out.append("Breadcrumbs:\t");
+        append_decimal(out, count);
+        out.append(" passing assertions before the failure, most recent first\n");
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out.append("\t\t#");
+            append_decimal(out, i);
+            out.append(' ');
+            append_decimal(out, now - crumbs[i].tsc);
+            out.append(" ticks before\t");
+            if (const site_info *site = find_site(crumbs[i].site_id))
+            {
+                std::string_view file(site->file), expr(site->expr_str);
+                out.append(file.substr(0, breadcrumb_field_max));
+                out.append(':');
+                append_decimal(out, site->line);
+                out.append('\t');
+                out.append(expr.substr(0, breadcrumb_field_max));
+            }
+            else
+            {
+                out.append("site ");
+                append_hex(out, crumbs[i].site_id);
+            }
+            out.append('\n');
+        }
+        return out.finish();
+    }
+    /** Appends `,"breadcrumbs":[{"site":"0x1f2e3d4c","ticks":1520},...]`. */
+    inline void append_json_breadcrumbs(fixed_writer &out)
+    {
+        breadcrumb crumbs[ASSERTIFY_BREADCRUMB_DEPTH];
+        std::size_t count = recent_breadcrumbs(crumbs, ASSERTIFY_BREADCRUMB_DEPTH);
+        std::uint64_t now = read_tsc();
+        out.append(",\"breadcrumbs\":[");
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out.append(i == 0 ? "{\"site\":\"" : ",{\"site\":\"");
+            append_hex(out, crumbs[i].site_id);
+            out.append("\",\"ticks\":");
+            append_decimal(out, now - crumbs[i].tsc);
+            out.append('}');
+        }
+        out.append(']');
+    }
+} // namespace detail
+
+#else
+
+namespace detail
+{
+    inline constexpr std::size_t breadcrumb_text_size = 0;
+    inline constexpr std::size_t breadcrumb_json_size = 0;
+
+    inline std::size_t format_breadcrumbs(char *, std::size_t) { return 0; }
+    inline void append_json_breadcrumbs(fixed_writer &) {}
+} // namespace detail
+
+#endif // ASSERTIFY_BREADCRUMBS_ENABLED
+
+/** Kinds of failure, one per family of assertion macros. */
+enum class category : std::uint8_t
+{
+    /** `ASSERT_ABORT` and `ASSERTIFY_ASSERT_*`: the process terminates. */
+    fatal,
+    /** `ASSERTIFY_CHECK`: reported subject to rate limiting; the program continues. */
+    recoverable,
+    /** `ASSERTIFY_EXPECT`: recorded, and reported per site when drained. */
+    soft,
+};
+
+/** Serialization of failure reports, selected with `assertify::set_sink`. */
+enum class sink_format : std::uint8_t
+{
+    /** The tab-separated report meant for humans. */
+    text,
+    /** One JSON object per line. */
+    json_lines,
+    /** Length-prefixed records, see `binary_record_header`. */
+    binary,
+};
+
+/**
+ * @brief
+ *  Fixed part of a record in the binary sink format. It is followed by the
+ *  file, expression and message, each null-terminated, then `operand_size`
+ *  bytes of captured operands and `frame_count` 64-bit return addresses, all
+ *  unaligned. Records are written back to back.
+ */
+struct binary_record_header
+{
+    /** Size of the whole record, header included. */
+    std::uint32_t size;
+    std::uint16_t version;
+    /** A `category` value. */
+    std::uint8_t category;
+    std::uint8_t flags;
+    std::uint32_t site_id;
+    std::int32_t line;
+    std::uint64_t thread_id;
+    std::uint64_t timestamp_ns;
+    /** Failures the record stands for, including suppressed or aggregated ones. */
+    std::uint64_t count;
+    /** Load address of the main executable, for symbolizing the frames. */
+    std::uint64_t load_base;
+    std::uint16_t operand_size;
+    std::uint16_t frame_count;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(binary_record_header) == 56, "binary_record_header is part of a wire format");
+
+inline constexpr std::uint16_t binary_record_version = 1;
+
+/** A decoded binary record. The views point into the decoded buffer. */
+struct binary_record
+{
+    binary_record_header header;
+    std::string_view file;
+    std::string_view expr_str;
+    std::string_view msg;
+    std::string_view operands;
+    /** `header.frame_count` unaligned 64-bit addresses. */
+    std::string_view frames;
+};
+
+/**
+ * @brief
+ *  Decodes the binary record at the start of `data`.
+ * @return Size of the record, or 0 if `data` does not start with a complete
+ *  record of this version.
+ */
+inline std::size_t decode_binary_record(const void *data, std::size_t size, binary_record &out)
+{
+    if (size < sizeof(binary_record_header))
+        return 0;
+    const char *bytes = static_cast<const char *>(data);
+    for (std::size_t i = 0; i < sizeof(binary_record_header); ++i)
+        reinterpret_cast<char *>(&out.header)[i] = bytes[i];
+    if (out.header.version != binary_record_version ||
+        out.header.size < sizeof(binary_record_header) || out.header.size > size)
+        return 0;
+
+    std::string_view rest(bytes + sizeof(binary_record_header),
+                          out.header.size - sizeof(binary_record_header));
+    std::string_view *fields[] = {&out.file, &out.expr_str, &out.msg};
+    for (std::string_view *field : fields)
+    {
+        std::size_t end = rest.find('\0');
+        if (end == std::string_view::npos)
+            return 0;
+        *field = rest.substr(0, end);
+        rest.remove_prefix(end + 1);
+    }
+    if (rest.size() != out.header.operand_size + out.header.frame_count * sizeof(std::uint64_t))
+        return 0;
+    out.operands = rest.substr(0, out.header.operand_size);
+    out.frames = rest.substr(out.header.operand_size);
+    return out.header.size;
+}
+
+/** A failure as passed to a handler installed with `assertify::set_handler`. */
+struct failure_info
+{
+    category kind;
+    const char *expr_str;
+    const char *file;
+    int line;
+    const char *msg;
+    /** Failures this call stands for, including suppressed or aggregated ones. */
+    std::uint64_t count;
+    /** Raw bytes of the operands captured by `ASSERTIFY_ASSERT_FMT`, if any. */
+    const void *operands;
+    std::size_t operand_size;
+    /** Return addresses of the failing thread, if stack traces are enabled. */
+    void *const *frames;
+    std::size_t frame_count;
+};
+
+using failure_handler = void (*)(const failure_info &);
+
+namespace detail
+{
+    /** What a sink records about a failure besides its `failure`. */
+    struct sink_event
+    {
+        category kind;
+        std::uint64_t count;
+        std::uint64_t timestamp_ns;
+        std::uint64_t thread_id;
+        void *const *frames = nullptr;
+        std::size_t frame_count = 0;
+    };
+
+    inline std::atomic<failure_handler> g_handlers[3] = {};
+
+    /**
+     * @brief
+     *  Passes the failure to the handler installed for its category.
+     * @return `false` if there is none and the failure should go to the sink.
+     */
+    inline bool call_handler(const failure &f, const sink_event &e)
+    {
+        failure_handler handler =
+            g_handlers[static_cast<std::size_t>(e.kind)].load(std::memory_order_acquire);
+        if (handler == nullptr)
+            return false;
+        handler({e.kind, f.expr_str, f.file, f.line, f.msg, e.count, f.operands, f.operand_size,
+                 e.frames, e.frame_count});
+        return true;
+    }
+
+    struct sink_config
+    {
+        sink_format format;
+        int fd;
+    };
+
+    inline std::atomic<sink_config> g_sink{sink_config{sink_format::text, 2}};
+
+    // Structured records cut their fields to these sizes, so that any record
+    // fits in `sink_record_size` bytes.
+    inline constexpr std::size_t sink_string_max = 256;
+    inline constexpr std::size_t sink_msg_max = 512;
+    inline constexpr std::size_t sink_operand_max = 64;
+
+    inline constexpr std::size_t sink_text_size =
+        ASSERTIFY_REPORT_BUFFER_SIZE + 64 + ASSERTIFY_STACKTRACE_DEPTH * 32 + breadcrumb_text_size;
+    inline constexpr std::size_t sink_json_size =
+        512 + 2 * sink_string_max + sink_msg_max + 2 * sink_operand_max +
+        ASSERTIFY_STACKTRACE_DEPTH * 22 + breadcrumb_json_size;
+
+    /** Upper bound of one serialized record in any format. */
+    inline constexpr std::size_t sink_record_size =
+        sink_text_size > sink_json_size ? sink_text_size : sink_json_size;
+
+    /**
+     * Length of the well-formed UTF-8 sequence that starts at `s`, or 0 if
+     * it is not one: overlong forms, surrogates and code points past
+     * U+10FFFF are rejected. Stops at the terminating NUL.
+     */
+    inline std::size_t utf8_sequence(const unsigned char *s)
+    {
+        std::size_t n;
+        unsigned char low = 0x80, high = 0xbf;
+        if (s[0] >= 0xc2 && s[0] <= 0xdf)
+            n = 2;
+        else if (s[0] >= 0xe0 && s[0] <= 0xef)
+        {
+            n = 3;
+            low = s[0] == 0xe0 ? 0xa0 : 0x80;
+            high = s[0] == 0xed ? 0x9f : 0xbf;
+        }
+        else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+        {
+            n = 4;
+            low = s[0] == 0xf0 ? 0x90 : 0x80;
+            high = s[0] == 0xf4 ? 0x8f : 0xbf;
+        }
+        else
+            return 0;
+        if (s[1] < low || s[1] > high)
+            return 0;
+        for (std::size_t i = 2; i < n; ++i)
+        {
+            if (s[i] < 0x80 || s[i] > 0xbf)
+                return 0;
+        }
+        return n;
+    }
+
+    /**
+     * Appends `s` as a JSON string of at most `budget` escaped characters.
+     * Multi-byte UTF-8 sequences are kept whole or cut off entirely, and
+     * bytes that are not valid UTF-8 become U+FFFD.
+     */
+    inline void append_json_string(fixed_writer &out, const char *s, std::size_t budget)
+    {
+        static constexpr char digits[] = "0123456789abcdef";
+        out.append('"');
+        for (; s != nullptr && *s != '\0'; ++s)
+        {
+            auto c = static_cast<unsigned char>(*s);
+            if (c >= 0x80)
+            {
+                std::size_t n = utf8_sequence(reinterpret_cast<const unsigned char *>(s));
+                if ((n == 0 ? 6 : n) > budget)
+                    break;
+                if (n == 0)
+                    out.append("\\ufffd", 6);
+                else
+                    out.append(s, n);
+                budget -= n == 0 ? 6 : n;
+                s += n == 0 ? 0 : n - 1;
+                continue;
+            }
+            char escaped[6] = {'\\', static_cast<char>(c)};
+            std::size_t n = 2;
+            if (c == '\n')
+                escaped[1] = 'n';
+            else if (c == '\t')
+                escaped[1] = 't';
+            else if (c == '\r')
+                escaped[1] = 'r';
+            else if (c < 0x20)
+            {
+                escaped[1] = 'u';
+                escaped[2] = escaped[3] = '0';
+                escaped[4] = digits[c >> 4];
+                escaped[5] = digits[c & 0xf];
+                n = 6;
+            }
+            else if (c != '"' && c != '\\')
+            {
+                escaped[0] = static_cast<char>(c);
+                n = 1;
+            }
+            if (n > budget)
+                break;
+            out.append(escaped, n);
+            budget -= n;
+        }
+        out.append('"');
+    }
+
+    /**
+     * @brief
+     *  Formats `f` as one line of JSON:
+     *
+     *  @code
+     *  {"kind":"fatal","expr":"n < cap","file":"src/a.cpp","line":12,"msg":"...",
+     *   "thread":4711,"ts":1697040000000000000,"count":1,"operands":"0a000000",
+     *   "build_id":"4f1c...","base":"0x55d0c0a4b000","stack":["0x55d0c0a4c1a2"]}
+     *  @endcode
+     */
+    inline std::size_t format_json_record(char *buf, std::size_t cap, const failure &f,
+                                          const sink_event &e)
+    {
+        static constexpr const char *kinds[] = {"fatal", "recoverable", "soft"};
+        static constexpr char digits[] = "0123456789abcdef";
+        fixed_writer out(buf, cap);
+        out.append("{\"kind\":\"");
+        out.append(kinds[static_cast<std::size_t>(e.kind)]);
+        out.append("\",\"expr\":");
+        append_json_string(out, f.expr_str, sink_string_max);
+        out.append(",\"file\":");
+        append_json_string(out, f.file, sink_string_max);
+        out.append(",\"line\":");
+        append_decimal(out, f.line);
+        out.append(",\"msg\":");
+        append_json_string(out, f.msg, sink_msg_max);
+        out.append(",\"thread\":");
+        append_decimal(out, e.thread_id);
+        out.append(",\"ts\":");
+        append_decimal(out, e.timestamp_ns);
+        out.append(",\"count\":");
+        append_decimal(out, e.count);
+        if (f.operand_size > 0)
+        {
+            std::size_t size = f.operand_size < sink_operand_max ? f.operand_size
+                                                                 : sink_operand_max;
+            out.append(",\"operands\":\"");
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                auto byte = static_cast<const unsigned char *>(f.operands)[i];
+                out.append(digits[byte >> 4]);
+                out.append(digits[byte & 0xf]);
+            }
+            out.append('"');
+        }
+        if (e.frame_count > 0)
+        {
+            module_info module = main_module();
+            out.append(",\"build_id\":\"");
+            append_build_id(out, module);
+            out.append("\",\"base\":\"");
+            append_hex(out, module.base);
+            out.append("\",\"stack\":[");
+            for (std::size_t i = 0; i < e.frame_count; ++i)
+            {
+                out.append(i == 0 ? "\"" : ",\"");
+                append_hex(out, reinterpret_cast<std::uintptr_t>(e.frames[i]));
+                out.append('"');
+            }
+            out.append(']');
+        }
+        if (e.kind == category::fatal)
+            append_json_breadcrumbs(out);
+        out.append("}\n");
+        return out.finish();
+    }
+
+    inline std::size_t encode_binary_record(char *buf, const failure &f, const sink_event &e)
+    {
+        binary_record_header header{};
+        header.version = binary_record_version;
+        header.category = static_cast<std::uint8_t>(e.kind);
+        header.site_id = site_id(f.file, f.line);
+        header.line = f.line;
+        header.thread_id = e.thread_id;
+        header.timestamp_ns = e.timestamp_ns;
+        header.count = e.count;
+        if (e.frame_count > 0)
+            header.load_base = main_module().base;
+
+        std::size_t size = sizeof(header);
+        const char *fields[] = {f.file, f.expr_str, f.msg};
+        const std::size_t caps[] = {sink_string_max, sink_string_max, sink_msg_max};
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            fixed_writer out(buf + size, caps[i]);
+            out.append(fields[i] != nullptr ? fields[i] : "");
+            size += out.finish() + 1;
+        }
+
+        header.operand_size = static_cast<std::uint16_t>(
+            f.operand_size < sink_operand_max ? f.operand_size : sink_operand_max);
+        for (std::size_t i = 0; i < header.operand_size; ++i)
+            buf[size++] = static_cast<const char *>(f.operands)[i];
+        header.frame_count = static_cast<std::uint16_t>(e.frame_count);
+        for (std::size_t i = 0; i < e.frame_count; ++i)
+        {
+            auto address = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(e.frames[i]));
+            for (std::size_t b = 0; b < sizeof(address); ++b)
+                buf[size++] = reinterpret_cast<const char *>(&address)[b];
+        }
+
+        header.size = static_cast<std::uint32_t>(size);
+        for (std::size_t i = 0; i < sizeof(header); ++i)
+            buf[i] = reinterpret_cast<const char *>(&header)[i];
+        return size;
+    }
+
+    /**
+     * @brief
+     *  Serializes failures in the format of the current sink into a fixed
+     *  buffer, and writes them out with one `write(2)` whenever the buffer
+     *  cannot take another record, or on `flush()`. Nothing is allocated.
+     */
+    template <std::size_t Capacity>
+    class sink_writer
+    {
+        static_assert(Capacity >= sink_record_size, "sink buffer too small for one record");
+
+    public:
+        sink_writer() : m_sink(g_sink.load(std::memory_order_acquire)) {}
+
+        sink_format format() const { return m_sink.format; }
+
+        /**
+         * @brief
+         *  Adds one failure. `text` is its report in the text format, and is
+         *  only used by that format.
+         */
+        void add(const failure &f, const sink_event &e, const char *text, std::size_t text_size)
+        {
+            if (Capacity - m_size < sink_record_size)
+                flush();
+            char *buf = m_buf + m_size;
+            switch (m_sink.format)
+            {
+            case sink_format::text:
+                if (text_size > ASSERTIFY_REPORT_BUFFER_SIZE)
+                    text_size = ASSERTIFY_REPORT_BUFFER_SIZE;
+                for (std::size_t i = 0; i < text_size; ++i)
+                    buf[i] = text[i];
+                m_size += text_size;
+                if (e.frame_count > 0)
+                    m_size += format_stacktrace(m_buf + m_size, Capacity - m_size, main_module(),
+                                                e.frames, e.frame_count);
+                if (e.kind == category::fatal)
+                    m_size += format_breadcrumbs(m_buf + m_size, Capacity - m_size);
+                break;
+            case sink_format::json_lines:
+                m_size += format_json_record(buf, sink_record_size, f, e);
+                break;
+            case sink_format::binary:
+                m_size += encode_binary_record(buf, f, e);
+                break;
+            }
+        }
+
+        void flush()
+        {
+            write_report(m_buf, m_size, m_sink.fd);
+            m_size = 0;
+        }
+
+    private:
+        sink_config m_sink;
+        std::size_t m_size = 0;
+        char m_buf[Capacity];
+    };
+
+    /** Writes a single failure to its handler or to the current sink. */
+    inline void write_failure(const failure &f, const sink_event &e, const char *text,
+                              std::size_t text_size)
+    {
+        if (call_handler(f, e))
+            return;
+        sink_writer<sink_record_size> out;
+        out.add(f, e, text, text_size);
+        out.flush();
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Selects the format of failure reports and the file descriptor they are
+ *  written to, stderr by default. May be called while other threads are
+ *  failing; each report is written entirely to either the old or the new
+ *  sink.
+ */
+inline void set_sink(sink_format format, int fd = 2)
+{
+    detail::g_sink.store({format, fd}, std::memory_order_release);
+}
+
+/**
+ * @brief
+ *  Installs `handler` for failures of category `kind`, in place of writing
+ *  them to the sink; `nullptr` restores the sink. Safe to call while other
+ *  threads are failing: each failure sees either the old or the new handler.
+ *
+ *  Fatal failures still terminate the process when the handler returns,
+ *  unless it throws. Recoverable failures reach the handler subject to the
+ *  site's rate limit, and soft failures once per site when they are flushed.
+ *
+ * @return The previously installed handler.
+ */
+inline failure_handler set_handler(category kind, failure_handler handler)
+{
+    return detail::g_handlers[static_cast<std::size_t>(kind)].exchange(handler,
+                                                                       std::memory_order_acq_rel);
+}
+
+namespace detail
+{
+#if defined(ASSERTIFY_HAS_THREADS)
+    using short_mutex = std::mutex;
+#else
+    /** Lock for the short critical sections of consumers, where `<mutex>` is not included. */
+    class short_mutex
+    {
+    public:
+        void lock()
+        {
+            while (m_flag.test_and_set(std::memory_order_acquire))
+            {
+            }
+        }
+
+        void unlock() { m_flag.clear(std::memory_order_release); }
+
+    private:
+        std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+    };
+#endif
+
+    /** Holds a `short_mutex` for the rest of the scope. */
+    class short_lock
+    {
+    public:
+        explicit short_lock(short_mutex &mutex) : m_mutex(mutex) { m_mutex.lock(); }
+        ~short_lock() { m_mutex.unlock(); }
+        short_lock(const short_lock &) = delete;
+        short_lock &operator=(const short_lock &) = delete;
+
+    private:
+        short_mutex &m_mutex;
+    };
+
+    /**
+     * @brief
+     *  Single-producer single-consumer ring owned by one thread. The owning
+     *  thread appends records without locks or system calls; consumers take
+     *  them under a lock of their own. Rings are never freed: when their
+     *  thread exits they are retired, and once drained adopted by the next
+     *  thread that needs one.
+     */
+    template <class Record, std::uint32_t Capacity>
+    struct thread_ring
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+        alignas(64) std::atomic<std::uint32_t> head{0};
+        /** Producer's last known value of `tail`. */
+        std::uint32_t cached_tail = 0;
+        std::atomic<std::uint64_t> dropped{0};
+        alignas(64) std::atomic<std::uint32_t> tail{0};
+        std::atomic<bool> retired{false};
+        /** `thread_id()` of the owning thread. */
+        std::atomic<std::uint64_t> owner{0};
+        thread_ring *next = nullptr;
+        Record records[Capacity];
+
+        /** Appends `record`, or drops and counts it if the ring is full. */
+        bool push(const Record &record)
+        {
+            std::uint32_t h = head.load(std::memory_order_relaxed);
+            if (h - cached_tail == Capacity)
+            {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (h - cached_tail == Capacity)
+                {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            records[h & (Capacity - 1)] = record;
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Passes every pending record to `fn`. Consumers must not race. */
+        template <class Fn>
+        void consume(Fn &&fn)
+        {
+            std::uint32_t t = tail.load(std::memory_order_relaxed);
+            std::uint32_t h = head.load(std::memory_order_acquire);
+            for (; t != h; ++t)
+                fn(records[t & (Capacity - 1)]);
+            tail.store(t, std::memory_order_release);
+        }
+    };
+
+    /** Lock-free list of the rings of type `Ring` of all threads. */
+    template <class Ring>
+    inline std::atomic<Ring *> g_rings{nullptr};
+
+    template <class Ring>
+    inline thread_local Ring *t_ring = nullptr;
+
+    template <class Ring>
+    struct ring_owner
+    {
+        ~ring_owner()
+        {
+            if (t_ring<Ring> != nullptr)
+                t_ring<Ring>->retired.store(true, std::memory_order_release);
+            t_ring<Ring> = nullptr;
+        }
+    };
+
+    /**
+     * @brief
+     *  Gives the calling thread a ring, adopting a retired one if possible,
+     *  and arranges for it to be retired when the thread exits.
+     */
+    template <class Ring>
+    ASSERTIFY_COLD Ring *acquire_ring()
+    {
+        static thread_local ring_owner<Ring> owner;
+        (void)owner;
+
+        Ring *head = g_rings<Ring>.load(std::memory_order_acquire);
+        Ring *ring = head;
+        for (; ring != nullptr; ring = ring->next)
+        {
+            // Only drained rings are adopted, so every thread starts with the
+            // full capacity.
+            bool retired = true;
+            if (ring->tail.load(std::memory_order_acquire) ==
+                    ring->head.load(std::memory_order_relaxed) &&
+                ring->retired.compare_exchange_strong(retired, false, std::memory_order_acquire))
+                break;
+        }
+        if (ring == nullptr)
+        {
+            ring = new Ring;
+            ring->next = head;
+            while (!g_rings<Ring>.compare_exchange_weak(ring->next, ring,
+                                                        std::memory_order_release,
+                                                        std::memory_order_acquire))
+            {
+            }
+        }
+        ring->owner.store(thread_id(), std::memory_order_relaxed);
+        return t_ring<Ring> = ring;
+    }
+
+    /** The ring of type `Ring` of the calling thread. */
+    template <class Ring>
+    inline Ring *local_ring()
+    {
+        Ring *ring = t_ring<Ring>;
+        return ring != nullptr ? ring : acquire_ring<Ring>();
+    }
+
+    /** Records dropped so far by all rings of type `Ring`. */
+    template <class Ring>
+    std::uint64_t ring_dropped()
+    {
+        std::uint64_t dropped = 0;
+        for (Ring *ring = g_rings<Ring>.load(std::memory_order_acquire); ring != nullptr;
+             ring = ring->next)
+            dropped += ring->dropped.load(std::memory_order_relaxed);
+        return dropped;
+    }
+} // namespace detail
+
+#if defined(ASSERTIFY_TRACING)
+
+namespace detail
+{
+    inline std::uint64_t monotonic_ns()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now().time_since_epoch())
+                                              .count());
+    }
+
+    /** A complete ("X") trace event: one evaluation or one failure report. */
+    struct trace_event
+    {
+        const char *name;
+        const char *file;
+        int line;
+        /** 0 for an evaluation, otherwise 1 + the `category` of a failure. */
+        std::uint32_t kind;
+        std::uint64_t begin_ns;
+        std::uint64_t duration_ns;
+    };
+
+    using trace_ring = thread_ring<trace_event, ASSERTIFY_TRACE_BUFFER_SIZE>;
+
+    struct trace_output
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        int fd = -1;
+        bool first = true;
+        bool stop = false;
+        std::thread thread;
+
+        /** Stops the writer thread, writes the remaining events and closes the file. */
+        void shut_down();
+
+        // A program that exits with a trace running, by returning from main or
+        // through a failure, completes the file here
+        ~trace_output() { shut_down(); }
+    };
+
+    inline std::atomic<bool> g_tracing{false};
+    inline trace_output g_trace;
+
+    /**
+     * @brief
+     *  Evaluates `eval()` and, while a trace is running, records it if it took
+     *  at least `ASSERTIFY_TRACE_MIN_NS`.
+     */
+    template <class Fn>
+    bool trace_eval(const char *expr_str, const char *file, int line, Fn &&eval)
+    {
+        if (!g_tracing.load(std::memory_order_relaxed))
+            return eval();
+        std::uint64_t begin = monotonic_ns();
+        bool result = eval();
+        std::uint64_t duration = monotonic_ns() - begin;
+        if (duration >= ASSERTIFY_TRACE_MIN_NS)
+            local_ring<trace_ring>()->push({expr_str, file, line, 0, begin, duration});
+        return result;
+    }
+
+    /** Start of a traced failure report, or 0 if no trace is running. */
+    inline std::uint64_t trace_begin()
+    {
+        return g_tracing.load(std::memory_order_relaxed) ? monotonic_ns() : 0;
+    }
+
+    inline void trace_end(std::uint64_t begin, const failure &f, category kind)
+    {
+        if (begin == 0)
+            return;
+        local_ring<trace_ring>()->push({f.expr_str, f.file, f.line,
+                                        1 + static_cast<std::uint32_t>(kind), begin,
+                                        monotonic_ns() - begin});
+    }
+
+    inline void append_micros(fixed_writer &out, std::uint64_t ns)
+    {
+        char fraction[4] = {'.', static_cast<char>('0' + ns / 100 % 10),
+                            static_cast<char>('0' + ns / 10 % 10),
+                            static_cast<char>('0' + ns % 10)};
+        append_decimal(out, ns / 1000);
+        out.append(fraction, sizeof(fraction));
+    }
+
+    inline std::size_t format_trace_event(char *buf, std::size_t cap, const trace_event &e,
+                                          std::uint64_t tid)
+    {
+        static constexpr const char *kinds[] = {"fatal", "recoverable", "soft"};
+        fixed_writer out(buf, cap);
+        out.append("{\"name\":");
+        append_json_string(out, e.name, sink_string_max);
+        out.append(e.kind == 0 ? ",\"cat\":\"assertify\"" : ",\"cat\":\"assertify.failure\"");
+        out.append(",\"ph\":\"X\",\"ts\":");
+        append_micros(out, e.begin_ns);
+        out.append(",\"dur\":");
+        append_micros(out, e.duration_ns);
+#if defined(__unix__) || defined(__APPLE__)
+        out.append(",\"pid\":");
+        append_decimal(out, ::getpid());
+#endif
+        out.append(",\"tid\":");
+        append_decimal(out, tid);
+        out.append(",\"args\":{\"file\":");
+        append_json_string(out, e.file, sink_string_max);
+        out.append(",\"line\":");
+        append_decimal(out, e.line);
+        if (e.kind != 0)
+        {
+            out.append(",\"kind\":\"");
+            out.append(kinds[e.kind - 1]);
+            out.append('"');
+        }
+        out.append("}}");
+        return out.finish();
+    }
+
+    /** Writes the pending events of all threads. Requires `g_trace.mutex`. */
+    inline void write_trace_events()
+    {
+        constexpr std::size_t event_max = 2 * sink_string_max + 256;
+        char buf[ASSERTIFY_SINK_BUFFER_SIZE];
+        std::size_t size = 0;
+        auto *ring = g_rings<trace_ring>.load(std::memory_order_acquire);
+        for (; ring != nullptr; ring = ring->next)
+        {
+            std::uint64_t tid = ring->owner.load(std::memory_order_relaxed);
+            ring->consume([&](const trace_event &e) {
+                if (sizeof(buf) - size < event_max)
+                {
+                    write_report(buf, size, g_trace.fd);
+                    size = 0;
+                }
+                buf[size++] = g_trace.first ? '\n' : ',';
+                if (!g_trace.first)
+                    buf[size++] = '\n';
+                g_trace.first = false;
+                size += format_trace_event(buf + size, event_max, e, tid);
+            });
+        }
+        write_report(buf, size, g_trace.fd);
+    }
+
+    /** Completes the trace file of a process that is about to terminate. */
+    inline void finish_trace()
+    {
+        if (!g_tracing.exchange(false))
+            return;
+        std::lock_guard<std::mutex> lock(g_trace.mutex);
+        write_trace_events();
+        write_report("\n]\n", 3, g_trace.fd);
+    }
+
+    inline void trace_output::shut_down()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        thread.join();
+        finish_trace();
+#if defined(__linux__)
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Starts recording assertion evaluations that take at least
+ *  `ASSERTIFY_TRACE_MIN_NS`, and failure reports, as Chrome trace events.
+ *  Events go to per-thread lock-free rings; a background thread appends them
+ *  to `path` every `interval`. The file is a JSON array loadable in Perfetto
+ *  or `chrome://tracing`, and stays loadable if the process dies mid-trace.
+ *
+ * @return `false` if the file could not be created or a trace is running.
+ */
+inline bool start_trace(const char *path,
+                        std::chrono::milliseconds interval =
+                            std::chrono::milliseconds(ASSERTIFY_TRACE_FLUSH_INTERVAL_MS))
+{
+#if defined(__linux__)
+    detail::trace_output &trace = detail::g_trace;
+    std::lock_guard<std::mutex> lock(trace.mutex);
+    if (trace.fd >= 0)
+        return false;
+    trace.fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (trace.fd < 0)
+        return false;
+    detail::write_report("[", 1, trace.fd);
+    trace.first = true;
+    trace.stop = false;
+    trace.thread = std::thread([interval] {
+        detail::trace_output &trace = detail::g_trace;
+        std::unique_lock<std::mutex> lock(trace.mutex);
+        while (!trace.stop)
+        {
+            trace.wake.wait_for(lock, interval, [&] { return trace.stop; });
+            // A fatal failure may already have closed the array
+            if (detail::g_tracing.load(std::memory_order_relaxed))
+                detail::write_trace_events();
+        }
+    });
+    detail::g_tracing.store(true);
+    return true;
+#else
+    (void)path;
+    (void)interval;
+    return false;
+#endif
+}
+
+/**
+ * @brief
+ *  Stops recording, writes the remaining events and closes the trace file.
+ */
+inline void stop_trace()
+{
+    detail::g_trace.shut_down();
+}
+
+/** Number of trace events dropped because a thread's ring was full. */
+inline std::uint64_t trace_dropped()
+{
+    return detail::ring_dropped<detail::trace_ring>();
+}
+
+#else
+
+namespace detail
+{
+    inline std::uint64_t trace_begin() { return 0; }
+    inline void trace_end(std::uint64_t, const failure &, category) {}
+    inline void finish_trace() {}
+} // namespace detail
+
+#if defined(ASSERTIFY_TRACE_ENABLED)
+// No writer thread on this platform: tracing cannot be started
+inline bool start_trace(const char *, std::chrono::milliseconds =
+                                         std::chrono::milliseconds(ASSERTIFY_TRACE_FLUSH_INTERVAL_MS))
+{
+    return false;
+}
+
+inline void stop_trace() {}
+
+inline std::uint64_t trace_dropped() { return 0; }
+#endif
+
+#endif // ASSERTIFY_TRACING
+
+namespace detail
+{
+    inline std::atomic<const void *> g_fatal_owner{nullptr};
+
+    /**
+     * @brief
+     *  First-failure-wins latch for fatal failures. The first thread to fail
+     *  reports and terminates the process; every other thread that fails in
+     *  the meantime waits here instead of piling onto stderr. If the owner's
+     *  fatal handler throws, the latch is released and a waiting thread
+     *  claims it in turn. A thread that fails again while reporting aborts
+     *  immediately.
+     */
+    inline void claim_fatal_failure()
+    {
+        static thread_local char self;
+        for (;;)
+        {
+            const void *owner = nullptr;
+            if (g_fatal_owner.compare_exchange_strong(owner, &self, std::memory_order_acq_rel))
+                return;
+            if (owner == &self)
+                std::abort();
+#if defined(__cpp_lib_atomic_wait)
+            g_fatal_owner.wait(owner, std::memory_order_acquire);
+#else
+            while (g_fatal_owner.load(std::memory_order_acquire) == owner)
+            {
+#if defined(ASSERTIFY_HAS_THREADS)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+            }
+#endif
+        }
+    }
+
+    /** Gives the latch back after a fatal handler threw, waking the threads waiting for it. */
+    inline void release_fatal_failure()
+    {
+        g_fatal_owner.store(nullptr, std::memory_order_release);
+#if defined(__cpp_lib_atomic_wait)
+        g_fatal_owner.notify_all();
+#endif
+    }
+
+    /**
+     * @brief
+     *  Lock-free token bucket for one reporting site, implemented as a
+     *  generic cell rate algorithm over a single atomic timestamp. A
+     *  suppressed failure costs one load and one increment. A limiter joins
+     *  `g_check_limiters` with its first report, so failures still
+     *  suppressed when the program exits can be reported then.
+     */
+    struct rate_limiter
+    {
+        /** Theoretical arrival time of the next report, monotonic nanoseconds. */
+        std::atomic<std::uint64_t> next{0};
+        std::atomic<std::uint64_t> suppressed{0};
+        /** The site, set once by the thread that lists the limiter. */
+        failure site{};
+        std::atomic<bool> listed{false};
+        rate_limiter *next_listed = nullptr;
+
+        /**
+         * @brief
+         *  Takes a token at time `now`. On success stores the number of
+         *  failures suppressed since the previous report in `suppressed_before`.
+         */
+        bool acquire(std::uint64_t now, std::uint64_t &suppressed_before)
+        {
+            constexpr std::uint64_t interval = ASSERTIFY_RATE_LIMIT_INTERVAL_MS * 1000000ull;
+            constexpr std::uint64_t tolerance = (ASSERTIFY_RATE_LIMIT_BURST - 1) * interval;
+            std::uint64_t tat = next.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                if (tat > now + tolerance)
+                {
+                    suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                std::uint64_t updated = (tat > now ? tat : now) + interval;
+                if (next.compare_exchange_weak(tat, updated, std::memory_order_relaxed))
+                    break;
+            }
+            suppressed_before = suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+    };
+
+    /** Every `rate_limiter` that has reported, newest first. */
+    inline std::atomic<rate_limiter *> g_check_limiters{nullptr};
+
+    /**
+     * @brief
+     *  Writes a "Check failed" report for `f` standing for `count`
+     *  failures, `suppressed` of which were held back by the rate limit.
+     */
+    ASSERTIFY_COLD inline void report_check(const failure &f, std::uint64_t suppressed,
+                                            std::uint64_t count)
+    {
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        std::size_t size = format_report(report, sizeof(report), "Check failed:\t", f);
+        if (suppressed > 0)
+        {
+            char digits[24];
+            auto end = std::to_chars(digits, digits + sizeof(digits), suppressed).ptr;
+            fixed_writer out(report + size, sizeof(report) - size);
+            out.append("Suppressed:\t");
+            out.append(digits, static_cast<std::size_t>(end - digits));
+            out.append(" more since the last report\n");
+            size += out.finish();
+        }
+        std::uint64_t traced = trace_begin();
+        write_failure(f, {category::recoverable, count, realtime_ns(), thread_id()}, report, size);
+        trace_end(traced, f, category::recoverable);
+        send_to_collector(f, nullptr, 0);
+    }
+
+    /** Reports the failures each check site still held back when the program exits. */
+    struct suppressed_reporter
+    {
+        ~suppressed_reporter()
+        {
+            for (rate_limiter *limiter = g_check_limiters.load(std::memory_order_acquire);
+                 limiter != nullptr; limiter = limiter->next_listed)
+            {
+                std::uint64_t suppressed = limiter->suppressed.exchange(0, std::memory_order_relaxed);
+                if (suppressed > 0)
+                    report_check(limiter->site, suppressed, suppressed);
+            }
+        }
+    };
+
+    /**
+     * @brief
+     *  Reports a failed `ASSERTIFY_CHECK` unless its site is over its rate
+     *  limit, and returns so the program can continue. Takes the site fields
+     *  in registers, so the caller does not reserve stack for a `failure`.
+     */
+    ASSERTIFY_COLD inline void check_failed(rate_limiter &limiter, const char *expr_str,
+                                            const char *file, int line, const char *msg)
+    {
+        const failure f{expr_str, file, line, msg};
+        std::uint64_t suppressed = 0;
+        if (!limiter.acquire(coarse_monotonic_ns(), suppressed))
+            return;
+        if (!limiter.listed.load(std::memory_order_relaxed) &&
+            !limiter.listed.exchange(true, std::memory_order_relaxed))
+        {
+            // Created with the first listed limiter, so it reports at exit
+            // before the sink and trace state it writes through is gone
+            static suppressed_reporter reporter;
+            (void)reporter;
+            limiter.site = f;
+            limiter.next_listed = g_check_limiters.load(std::memory_order_relaxed);
+            while (!g_check_limiters.compare_exchange_weak(limiter.next_listed, &limiter,
+                                                           std::memory_order_release,
+                                                           std::memory_order_relaxed))
+            {
+            }
+        }
+        report_check(f, suppressed, suppressed + 1);
+    }
+
+    /**
+     * @brief
+     *  Common tail of every fatal failure: records the failure in the crash
+     *  ring, passes the report and the stack trace to the fatal handler or
+     *  the sink, sends it to the collector, and then aborts, or exits with
+     *  `exit_code` if it is non-zero.
+     */
+    [[noreturn]] ASSERTIFY_COLD inline void fail(const failure &f, const char *report,
+                                                 std::size_t size, int exit_code)
+    {
+        claim_fatal_failure();
+        // Only runs if a fatal handler throws; the failure is then the
+        // caller's to deal with, and the next one may report again.
+        struct release_on_unwind
+        {
+            ~release_on_unwind() { release_fatal_failure(); }
+        } release;
+
+        void *frames[ASSERTIFY_STACKTRACE_DEPTH];
+        std::size_t count = capture_stack(frames, ASSERTIFY_STACKTRACE_DEPTH, 1);
+
+        // The crash ring goes first: writing the report can block on a full
+        // pipe or end in a fatal handler that never returns
+        record_crash(f, frames, count);
+        std::uint64_t traced = trace_begin();
+        write_failure(f, {category::fatal, 1, realtime_ns(), thread_id(), frames, count}, report,
+                      size);
+        trace_end(traced, f, category::fatal);
+        finish_trace();
+        send_to_collector(f, frames, count);
+        if (exit_code != 0)
+            std::exit(exit_code);
+        std::abort();
+    }
+
+    /** Formats and reports a failed `ASSERT_ABORT` and aborts; kept out of line so the passing path stays a test and a branch. */
+    [[noreturn]] ASSERTIFY_COLD inline void assert_failed(const failure &f)
+    {
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        fail(f, report, format_report(report, sizeof(report), "Assert failed:\t", f), 0);
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Maps a crash ring file that holds the last `capacity` fatal failures as
+ *  fixed-size binary records. Records are written before the process
+ *  terminates and survive it; decode them with `tools/assertify-ring`.
+ *
+ * @param path
+ *  File to create or truncate. Defaults to `/dev/shm/assertify.<pid>`.
+ *
+ * @param capacity
+ *  Number of records kept before the oldest is overwritten.
+ *
+ * @return `true` if the ring is open, `false` if it could not be created or
+ *  the platform is not supported.
+ */
+inline bool open_crash_ring(const char *path = nullptr,
+                            std::uint32_t capacity = ASSERTIFY_CRASH_RING_CAPACITY)
+{
+#if defined(__linux__)
+    char default_path[64];
+    if (path == nullptr)
+        path = detail::default_shm_path(default_path, sizeof(default_path), "assertify.");
+    if (capacity == 0 || detail::g_crash_ring.load() != nullptr)
+        return false;
+
+    std::size_t size = sizeof(crash_ring_header) + capacity * sizeof(crash_record);
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    void *map = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+        map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    auto *ring = static_cast<crash_ring_header *>(map);
+    detail::module_info module = detail::main_module();
+    for (std::size_t i = 0; i < sizeof(ring->magic); ++i)
+        ring->magic[i] = crash_ring_magic[i];
+    ring->version = crash_ring_version;
+    ring->record_size = sizeof(crash_record);
+    ring->capacity = capacity;
+    ring->pid = static_cast<std::uint32_t>(::getpid());
+    ring->load_base = module.base;
+    ring->build_id_size = static_cast<std::uint32_t>(module.build_id_size);
+    for (std::size_t i = 0; i < module.build_id_size; ++i)
+        ring->build_id[i] = module.build_id[i];
+    detail::g_crash_ring.store(ring, std::memory_order_release);
+    return true;
+#else
+    (void)path;
+    (void)capacity;
+    return false;
+#endif
+}
+
+/**
+ * @brief
+ *  Unmaps the crash ring. Must not race with a failing assertion.
+ */
+inline void close_crash_ring()
+{
+#if defined(__linux__)
+    crash_ring_header *ring = detail::g_crash_ring.exchange(nullptr);
+    if (ring != nullptr)
+        ::munmap(ring, sizeof(crash_ring_header) + ring->capacity * sizeof(crash_record));
+#endif
+}
+
+/**
+ * @brief
+ *  Pass and fail counters of one assertion site. With
+ *  `ASSERTIFY_STATS_ENABLED` defined, every assertion macro owns one of these
+ *  in the `assertify_stats` linker section, so all sites of the program can
+ *  be enumerated without static constructors.
+ *
+ *  The alignment fixes the stride of the section, which the compiler would
+ *  otherwise pad unpredictably, and keeps each site's counters on their own
+ *  cache line.
+ */
+struct alignas(64) site_stats
+{
+    const char *expr_str;
+    const char *file;
+    int line;
+    std::atomic<std::uint64_t> passed{0};
+    std::atomic<std::uint64_t> failed{0};
+    /** `CLOCK_REALTIME` of the latest failure in nanoseconds, 0 if none. */
+    std::atomic<std::uint64_t> last_failure_ns{0};
+
+    constexpr site_stats(const char *expr_str, const char *file, int line)
+        : expr_str(expr_str), file(file), line(line) {}
+};
+
+/**
+ * @brief
+ *  Start of a statistics segment published by `assertify::start_stats_export`,
+ *  followed by `count` entries. Readers take a consistent snapshot with
+ *  `read_stats`, which follows the `sequence` seqlock.
+ */
+struct stats_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entry_size;
+    std::uint32_t count;
+    std::uint32_t pid;
+    /** Odd while the exporter is updating the entries. */
+    std::atomic<std::uint64_t> sequence;
+    /** `CLOCK_REALTIME` of the latest update in nanoseconds. */
+    std::uint64_t updated_ns;
+};
+
+/** Counters of one site as published in a statistics segment. */
+struct stats_entry
+{
+    std::uint32_t site_id;
+    std::int32_t line;
+    std::uint64_t passed;
+    std::uint64_t failed;
+    std::uint64_t last_failure_ns;
+    char file[64];
+    char expr_str[96];
+};
+
+static_assert(sizeof(stats_header) == 40, "stats_header is part of a shared memory layout");
+static_assert(sizeof(stats_entry) == 192, "stats_entry is part of a shared memory layout");
+
+inline constexpr char stats_magic[8] = {'A', 'S', 'R', 'T', 'S', 'T', 'A', 'T'};
+inline constexpr std::uint32_t stats_version = 1;
+
+} // namespace assertify
+
+#if defined(__GNUC__) || defined(__clang__)
+// Provided by the linker for the sections that hold the per-site counters.
+extern "C" assertify::site_stats __start_assertify_stats[] __attribute__((weak, visibility("hidden")));
+extern "C" assertify::site_stats __stop_assertify_stats[] __attribute__((weak, visibility("hidden")));
+#endif
+
+namespace assertify
+{
+namespace detail
+{
+    inline bool count_result(site_stats &stats, bool result)
+    {
+        if (result)
+        {
+            stats.passed.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            stats.failed.fetch_add(1, std::memory_order_relaxed);
+            stats.last_failure_ns.store(realtime_ns(), std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+    inline std::size_t stats_segment_size(std::size_t count)
+    {
+        return sizeof(stats_header) + count * sizeof(stats_entry);
+    }
+
+    inline void publish_stats(stats_header *segment, site_stats *sites, std::size_t count)
+    {
+        auto *entries = reinterpret_cast<stats_entry *>(segment + 1);
+        std::uint64_t seq = segment->sequence.load(std::memory_order_relaxed);
+        segment->sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            entries[i].passed = sites[i].passed.load(std::memory_order_relaxed);
+            entries[i].failed = sites[i].failed.load(std::memory_order_relaxed);
+            entries[i].last_failure_ns = sites[i].last_failure_ns.load(std::memory_order_relaxed);
+        }
+        segment->updated_ns = realtime_ns();
+        segment->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+#if defined(__linux__)
+    struct stats_exporter
+    {
+        stats_header *segment = nullptr;
+        std::size_t size = 0;
+        site_stats *sites = nullptr;
+        std::size_t count = 0;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stop = false;
+        std::thread thread;
+
+        /** Stops the thread after a final update and unmaps the segment. */
+        void shut_down()
+        {
+            if (segment == nullptr)
+                return;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            wake.notify_one();
+            thread.join();
+            publish_stats(segment, sites, count);
+            ::munmap(segment, size);
+            segment = nullptr;
+        }
+
+        // A program that returns from main with the export running stops it here
+        ~stats_exporter() { shut_down(); }
+    };
+
+    /** Created by the first export, so programs that never start one carry no exit-time object. */
+    inline stats_exporter &stats_export_state()
+    {
+        static stats_exporter exporter;
+        return exporter;
+    }
+#endif
+} // namespace detail
+
+/**
+ * @brief
+ *  Returns the counters of every assertion site compiled with
+ *  `ASSERTIFY_STATS_ENABLED`, as a contiguous range.
+ */
+inline std::pair<site_stats *, site_stats *> stats_sites()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    if (__start_assertify_stats == nullptr)
+        return {nullptr, nullptr};
+    return {__start_assertify_stats, __stop_assertify_stats};
+#else
+    return {nullptr, nullptr};
+#endif
+}
+
+/** Outcome of `read_stats`. */
+enum class stats_read
+{
+    /** The snapshot is consistent. */
+    ok,
+    /**
+     * The exporter was updating the segment on every attempt, e.g. because it
+     * died in the middle of an update; the snapshot may mix two updates.
+     */
+    torn,
+    /** Not a statistics segment of this version; nothing was copied. */
+    invalid,
+};
+
+/**
+ * @brief
+ *  Copies a consistent snapshot of a statistics segment into `out`, and the
+ *  time of the update it belongs to into `updated_ns`. Only plain loads from
+ *  the shared mapping are involved, so a reader never stops or slows down
+ *  the observed process. Gives up after `attempts` tries that overlap an
+ *  update, keeping the last copy.
+ */
+inline stats_read read_stats(const stats_header *segment, std::vector<stats_entry> &out,
+                             std::uint64_t *updated_ns = nullptr, unsigned attempts = 1000)
+{
+    if (std::string_view(segment->magic, 8) != std::string_view(stats_magic, 8) ||
+        segment->version != stats_version || segment->entry_size != sizeof(stats_entry))
+        return stats_read::invalid;
+
+    const auto *entries = reinterpret_cast<const stats_entry *>(segment + 1);
+    for (unsigned attempt = 0;; ++attempt)
+    {
+        std::uint64_t before = segment->sequence.load(std::memory_order_acquire);
+        out.assign(entries, entries + segment->count);
+        std::uint64_t updated = segment->updated_ns;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool consistent = before % 2 == 0 &&
+                          segment->sequence.load(std::memory_order_relaxed) == before;
+        if (consistent || attempt + 1 >= attempts)
+        {
+            if (updated_ns != nullptr)
+                *updated_ns = updated;
+            return consistent ? stats_read::ok : stats_read::torn;
+        }
+#if defined(ASSERTIFY_HAS_THREADS)
+        std::this_thread::yield();
+#endif
+    }
+}
+
+#if defined(__linux__)
+/**
+ * @brief
+ *  Publishes the counters of all `ASSERTIFY_STATS_ENABLED` sites in a shared
+ *  memory file, `/dev/shm/assertify-stats.<pid>` by default, and starts a
+ *  background thread that refreshes it every `interval`. The file can be
+ *  watched live with `tools/assertify-top`.
+ *
+ * @return `false` if the file could not be created or an export is running.
+ */
+inline bool start_stats_export(const char *path = nullptr,
+                               std::chrono::milliseconds interval =
+                                   std::chrono::milliseconds(ASSERTIFY_STATS_INTERVAL_MS))
+{
+    detail::stats_exporter &exporter = detail::stats_export_state();
+    if (exporter.segment != nullptr)
+        return false;
+
+    char default_path[64];
+    if (path == nullptr)
+        path = detail::default_shm_path(default_path, sizeof(default_path), "assertify-stats.");
+
+    auto [sites, sites_end] = stats_sites();
+    std::size_t count = static_cast<std::size_t>(sites_end - sites);
+    std::size_t size = detail::stats_segment_size(count);
+
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    void *map = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+        map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    auto *segment = static_cast<stats_header *>(map);
+    auto *entries = reinterpret_cast<stats_entry *>(segment + 1);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        entries[i].site_id = detail::site_id(sites[i].file, sites[i].line);
+        entries[i].line = sites[i].line;
+        detail::copy_string(entries[i].file, sizeof(entries[i].file), sites[i].file);
+        detail::copy_string(entries[i].expr_str, sizeof(entries[i].expr_str), sites[i].expr_str);
+    }
+    segment->version = stats_version;
+    segment->entry_size = sizeof(stats_entry);
+    segment->count = static_cast<std::uint32_t>(count);
+    segment->pid = static_cast<std::uint32_t>(::getpid());
+    detail::publish_stats(segment, sites, count);
+    for (std::size_t i = 0; i < sizeof(segment->magic); ++i)
+        segment->magic[i] = stats_magic[i];
+
+    exporter.segment = segment;
+    exporter.size = size;
+    exporter.sites = sites;
+    exporter.count = count;
+    exporter.stop = false;
+    exporter.thread = std::thread([interval] {
+        detail::stats_exporter &exporter = detail::stats_export_state();
+        std::unique_lock<std::mutex> lock(exporter.mutex);
+        while (!exporter.wake.wait_for(lock, interval, [&] { return exporter.stop; }))
+            detail::publish_stats(exporter.segment, exporter.sites, exporter.count);
+    });
+    return true;
+}
+
+/**
+ * @brief
+ *  Stops the exporter thread after a final update and unmaps the segment.
+ *  The file is left in place for post-mortem inspection.
+ */
+inline void stop_stats_export()
+{
+    detail::stats_export_state().shut_down();
+}
+#endif
+} // namespace assertify
+
+#if defined(ASSERTIFY_PROFILE_ENABLED)
+
+namespace assertify
+{
+/** Calls and timer ticks of one site, counted by the threads of one shard. */
+struct alignas(64) profile_shard
+{
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> ticks{0};
+};
+
+/**
+ * @brief
+ *  Evaluation cost of one assertion site. With `ASSERTIFY_PROFILE_ENABLED`
+ *  defined, every site owns one of these in the `assertify_profile` linker
+ *  section. Threads are spread over `ASSERTIFY_PROFILE_SHARDS` shards, so
+ *  threads evaluating the same site rarely share a cache line.
+ */
+struct alignas(64) site_profile
+{
+    const char *expr_str;
+    const char *file;
+    int line;
+    profile_shard shards[ASSERTIFY_PROFILE_SHARDS];
+
+    constexpr site_profile(const char *expr_str, const char *file, int line)
+        : expr_str(expr_str), file(file), line(line) {}
+};
+
+/** Totals of one site in a profile snapshot. */
+struct profile_entry
+{
+    const site_profile *site;
+    std::uint64_t calls;
+    /** Ticks spent evaluating, with the timer overhead subtracted. */
+    std::uint64_t ticks;
+};
+} // namespace assertify
+
+// Provided by the linker for the section that holds the per-site profiles.
+extern "C" assertify::site_profile __start_assertify_profile[] __attribute__((weak, visibility("hidden")));
+extern "C" assertify::site_profile __stop_assertify_profile[] __attribute__((weak, visibility("hidden")));
+
+namespace assertify
+{
+namespace detail
+{
+    /**
+     * @brief
+     *  Reads the profiling timer: `rdtscp` on x86, which waits for the
+     *  preceding instructions to complete, and `CLOCK_MONOTONIC` elsewhere.
+     */
+    inline std::uint64_t read_timer()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned int aux;
+        return __builtin_ia32_rdtscp(&aux);
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now().time_since_epoch())
+                                              .count());
+#endif
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline constexpr std::string_view timer_unit = "cycles";
+#else
+    inline constexpr std::string_view timer_unit = "ns";
+#endif
+
+    inline std::atomic<std::uint32_t> g_next_profile_shard{0};
+    inline thread_local std::uint32_t t_profile_shard = 0;
+
+    template <class Fn>
+    bool profile_eval(site_profile &site, Fn &&eval)
+    {
+        std::uint64_t begin = read_timer();
+        bool result = eval();
+        std::uint64_t elapsed = read_timer() - begin;
+
+        std::uint32_t shard = t_profile_shard;
+        if (shard == 0)
+            shard = t_profile_shard =
+                1 + g_next_profile_shard.fetch_add(1, std::memory_order_relaxed) %
+                        ASSERTIFY_PROFILE_SHARDS;
+        profile_shard &counters = site.shards[shard - 1];
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+        counters.ticks.fetch_add(elapsed, std::memory_order_relaxed);
+        return result;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Ticks taken by an empty timed evaluation: the minimum over many
+ *  back-to-back timer reads. Measured once and subtracted from every call.
+ */
+inline std::uint64_t timer_overhead()
+{
+    static const std::uint64_t overhead = [] {
+        std::uint64_t best = ~std::uint64_t(0);
+        for (int i = 0; i < 10000; ++i)
+        {
+            std::uint64_t begin = detail::read_timer();
+            std::uint64_t elapsed = detail::read_timer() - begin;
+            if (elapsed < best)
+                best = elapsed;
+        }
+        return best;
+    }();
+    return overhead;
+}
+
+/**
+ * @brief
+ *  Sums the shards of every profiled site that was evaluated, and sorts the
+ *  sites by ticks spent, most expensive first.
+ */
+inline std::vector<profile_entry> profile_snapshot()
+{
+    std::vector<profile_entry> entries;
+    if (__start_assertify_profile == nullptr)
+        return entries;
+    std::uint64_t overhead = timer_overhead();
+    for (site_profile *site = __start_assertify_profile; site != __stop_assertify_profile; ++site)
+    {
+        profile_entry entry{site, 0, 0};
+        for (const profile_shard &shard : site->shards)
+        {
+            entry.calls += shard.calls.load(std::memory_order_relaxed);
+            entry.ticks += shard.ticks.load(std::memory_order_relaxed);
+        }
+        if (entry.calls == 0)
+            continue;
+        entry.ticks = entry.ticks > entry.calls * overhead ? entry.ticks - entry.calls * overhead
+                                                           : 0;
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const profile_entry &a, const profile_entry &b) {
+        return a.ticks > b.ticks;
+    });
+    return entries;
+}
+
+/**
+ * @brief
+ *  Writes a table of the `top` most expensive sites to stderr, or to `fd`:
+ *
+ *  @code
+ *  Assertion profile:  top 2 of 5 sites by total cycles, timer overhead 24 cycles subtracted
+ *         calls             total     per call  site
+ *        100000          81234567        812.3  src/tree.cpp:88  is_balanced(root)
+ *       2500000           9876543          4.0  src/vec.cpp:12  i < size()
+ *  @endcode
+ */
+inline void print_profile(std::size_t top = ASSERTIFY_PROFILE_TOP, int fd = 2)
+{
+    std::vector<profile_entry> entries = profile_snapshot();
+    if (entries.empty())
+        return;
+    if (top > entries.size())
+        top = entries.size();
+
+    char buf[ASSERTIFY_SINK_BUFFER_SIZE];
+    detail::fixed_writer out(buf, sizeof(buf));
+    auto column = [&out](std::string_view text, std::size_t width) {
+        for (std::size_t i = text.size(); i < width; ++i)
+            out.append(' ');
+        out.append(text);
+    };
+    auto number = [&column](std::uint64_t value, std::size_t width) {
+        char text[24];
+        auto end = std::to_chars(text, text + sizeof(text), value).ptr;
+        column(std::string_view(text, static_cast<std::size_t>(end - text)), width);
+    };
+
+    out.append("Assertion profile:\ttop ");
+    detail::append_decimal(out, top);
+    out.append(" of ");
+    detail::append_decimal(out, entries.size());
+    out.append(" sites by total ");
+    out.append(detail::timer_unit);
+    out.append(", timer overhead ");
+    detail::append_decimal(out, timer_overhead());
+    out.append(' ');
+    out.append(detail::timer_unit);
+    out.append(" subtracted\n");
+    column("calls", 14);
+    column("total", 18);
+    column("per call", 13);
+    out.append("  site\n");
+    for (std::size_t i = 0; i < top; ++i)
+    {
+        const profile_entry &entry = entries[i];
+        number(entry.calls, 14);
+        number(entry.ticks, 18);
+        std::uint64_t tenths = entry.ticks * 10 / entry.calls;
+        char per_call[24];
+        auto end = std::to_chars(per_call, per_call + sizeof(per_call) - 2, tenths / 10).ptr;
+        *end++ = '.';
+        *end++ = static_cast<char>('0' + tenths % 10);
+        column(std::string_view(per_call, static_cast<std::size_t>(end - per_call)), 13);
+        out.append("  ");
+        out.append(entry.site->file);
+        out.append(':');
+        detail::append_decimal(out, entry.site->line);
+        out.append("  ");
+        out.append(entry.site->expr_str);
+        out.append('\n');
+    }
+    detail::write_report(buf, out.finish(), fd);
+}
+
+namespace detail
+{
+    /** Prints the profile when the program exits. */
+    struct profile_printer
+    {
+        ~profile_printer() { print_profile(); }
+    };
+
+    inline profile_printer g_profile_printer;
+} // namespace detail
+} // namespace assertify
+
+#endif // ASSERTIFY_PROFILE_ENABLED
+
+namespace assertify
+{
+/** Where the `perf_counters` of the calling thread come from. */
+enum class perf_source
+{
+    /** Nothing is measured on this platform. */
+    none,
+    /** `perf_event_open` is blocked, e.g. by a container's seccomp policy: the
+     *  thread CPU clock and `getrusage(RUSAGE_THREAD)`. */
+    rusage,
+    /** Software perf events only: the hardware PMU is restricted or absent. */
+    software,
+    /** Hardware and software perf events. */
+    hardware,
+};
+
+/** One per-thread counter; the index into `perf_counters::values`. */
+enum class perf_counter : unsigned
+{
+    instructions,
+    branches,
+    branch_misses,
+    l1d_misses,
+    task_clock_ns,
+    context_switches,
+    page_faults,
+};
+
+inline constexpr std::size_t perf_counter_count = 7;
+
+inline constexpr std::string_view perf_counter_names[perf_counter_count] = {
+    "instructions", "branches",         "branch-misses", "l1d-misses",
+    "task-clock-ns", "context-switches", "page-faults",
+};
+
+inline constexpr std::string_view perf_source_names[] = {"none", "rusage", "software",
+                                                         "hardware"};
+
+/**
+ * @brief
+ *  Counts of the calling thread, cumulative or over an interval. Only the
+ *  counters whose bit is set in `available` were measured; the hardware ones
+ *  need an accessible PMU, the others fall back to `getrusage`. Adding or
+ *  subtracting keeps the counters available on both sides.
+ */
+struct perf_counters
+{
+    std::uint64_t values[perf_counter_count] = {};
+    std::uint32_t available = 0;
+    perf_source source = perf_source::none;
+
+    std::uint64_t operator[](perf_counter c) const { return values[static_cast<unsigned>(c)]; }
+    bool has(perf_counter c) const { return (available >> static_cast<unsigned>(c)) & 1; }
+
+    perf_counters &operator+=(const perf_counters &other)
+    {
+        for (std::size_t i = 0; i < perf_counter_count; ++i)
+            values[i] += other.values[i];
+        available &= other.available;
+        source = other.source;
+        return *this;
+    }
+
+    friend perf_counters operator-(perf_counters a, const perf_counters &b)
+    {
+        for (std::size_t i = 0; i < perf_counter_count; ++i)
+            a.values[i] = a.values[i] > b.values[i] ? a.values[i] - b.values[i] : 0;
+        a.available &= b.available;
+        return a;
+    }
+};
+
+namespace detail
+{
+#if defined(ASSERTIFY_HAS_PERF_EVENT)
+    /**
+     * @brief
+     *  The perf events of one thread, opened on first use as a single group so
+     *  one `read` returns all of them. Counting is limited to user space,
+     *  which `perf_event_paranoid` 2, the common default, still allows.
+     */
+    struct perf_group
+    {
+        bool opened = false;
+        int leader = -1;
+        int fds[perf_counter_count] = {-1, -1, -1, -1, -1, -1, -1};
+        /** Counter of each value in the group's read buffer, in read order. */
+        perf_counter order[perf_counter_count];
+        std::size_t size = 0;
+        std::uint32_t available = 0;
+        perf_source source = perf_source::rusage;
+
+        ~perf_group()
+        {
+            for (int fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+        }
+
+        void open()
+        {
+            opened = true;
+            constexpr std::uint64_t l1d_read_miss =
+                PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            const struct
+            {
+                std::uint32_t type;
+                std::uint64_t config;
+            } events[perf_counter_count] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+                {PERF_TYPE_HW_CACHE, l1d_read_miss},
+                {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+                {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+                {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            };
+            for (std::size_t i = 0; i < perf_counter_count; ++i)
+            {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = events[i].type;
+                attr.config = events[i].config;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                   PERF_FORMAT_TOTAL_TIME_RUNNING;
+                int fd = static_cast<int>(
+                    ::syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+                if (fd < 0)
+                    continue;
+                if (leader < 0)
+                    leader = fd;
+                fds[i] = fd;
+                order[size++] = static_cast<perf_counter>(i);
+                available |= 1u << i;
+            }
+            if (leader >= 0)
+                source = (available & 0xf) != 0 ? perf_source::hardware : perf_source::software;
+        }
+
+        /** Adds the group's values, scaled up if the kernel multiplexed it, to `out`. */
+        bool read(perf_counters &out) const
+        {
+            std::uint64_t buf[3 + perf_counter_count];
+            ssize_t n = ::read(leader, buf, sizeof(buf));
+            if (n < static_cast<ssize_t>((3 + size) * sizeof(std::uint64_t)))
+                return false;
+            std::uint64_t enabled = buf[1], running = buf[2];
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                std::uint64_t value = buf[3 + i];
+                if (running != 0 && running < enabled)
+                    value = static_cast<std::uint64_t>(static_cast<double>(value) *
+                                                       static_cast<double>(enabled) /
+                                                       static_cast<double>(running));
+                out.values[static_cast<unsigned>(order[i])] = value;
+            }
+            out.available = available;
+            return true;
+        }
+    };
+
+    /** The calling thread's perf group, created by its first read. */
+    inline perf_group &thread_perf_group()
+    {
+        static thread_local perf_group group;
+        return group;
+    }
+
+    /** Thread CPU time and resource usage, for when perf events cannot be opened. */
+    inline void read_rusage(perf_counters &out)
+    {
+        timespec ts;
+        if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        {
+            out.values[static_cast<unsigned>(perf_counter::task_clock_ns)] =
+                static_cast<std::uint64_t>(ts.tv_sec) * 1000000000u +
+                static_cast<std::uint64_t>(ts.tv_nsec);
+            out.available |= 1u << static_cast<unsigned>(perf_counter::task_clock_ns);
+        }
+        rusage usage;
+        if (::getrusage(RUSAGE_THREAD, &usage) == 0)
+        {
+            out.values[static_cast<unsigned>(perf_counter::context_switches)] =
+                static_cast<std::uint64_t>(usage.ru_nvcsw + usage.ru_nivcsw);
+            out.values[static_cast<unsigned>(perf_counter::page_faults)] =
+                static_cast<std::uint64_t>(usage.ru_minflt + usage.ru_majflt);
+            out.available |= 1u << static_cast<unsigned>(perf_counter::context_switches) |
+                             1u << static_cast<unsigned>(perf_counter::page_faults);
+        }
+    }
+#endif
+} // namespace detail
+
+/**
+ * @brief
+ *  Reads the cumulative counters of the calling thread. The first call on a
+ *  thread opens its perf events; later calls cost one `read` system call.
+ */
+inline perf_counters read_perf_counters()
+{
+    perf_counters counters;
+#if defined(ASSERTIFY_HAS_PERF_EVENT)
+    detail::perf_group &group = detail::thread_perf_group();
+    if (!group.opened)
+        group.open();
+    counters.source = group.source;
+    if (group.leader >= 0 && group.read(counters))
+        return counters;
+    counters.source = perf_source::rusage;
+    detail::read_rusage(counters);
+#endif
+    return counters;
+}
+
+/** Counters accumulated by every `perf_scope` of one region. */
+struct perf_region
+{
+    const char *name;
+    std::uint64_t calls;
+    perf_counters total;
+};
+
+namespace detail
+{
+    struct perf_regions
+    {
+        short_mutex mutex;
+        std::vector<perf_region> regions;
+    };
+
+    /** Created by the first `perf_scope`, so programs without one carry no exit-time object. */
+    inline perf_regions &perf_region_table()
+    {
+        static perf_regions table;
+        return table;
+    }
+
+    inline void add_perf_region(const char *name, const perf_counters &counters)
+    {
+        perf_regions &table = perf_region_table();
+        short_lock lock(table.mutex);
+        for (perf_region &region : table.regions)
+        {
+            if (std::string_view(region.name) == name)
+            {
+                ++region.calls;
+                region.total += counters;
+                return;
+            }
+        }
+        table.regions.push_back({name, 1, counters});
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Counts what the calling thread does between construction and destruction.
+ *  With a region name, the counts are added to that region on destruction,
+ *  for `perf_region_snapshot` and `print_perf_regions`. `region` must outlive
+ *  the program, e.g. a string literal.
+ *
+ *  @code
+ *  {
+ *      assertify::perf_scope scope("parse");
+ *      parse(input);
+ *  }
+ *  @endcode
+ */
+class perf_scope
+{
+public:
+    explicit perf_scope(const char *region = nullptr)
+        : m_region(region), m_start(read_perf_counters()) {}
+
+    ~perf_scope()
+    {
+        if (m_region != nullptr)
+            detail::add_perf_region(m_region, elapsed());
+    }
+
+    perf_scope(const perf_scope &) = delete;
+    perf_scope &operator=(const perf_scope &) = delete;
+
+    /** Counts since construction. */
+    perf_counters elapsed() const { return read_perf_counters() - m_start; }
+
+private:
+    const char *m_region;
+    perf_counters m_start;
+};
+
+/** Returns the regions recorded so far, in order of first use. */
+inline std::vector<perf_region> perf_region_snapshot()
+{
+    detail::perf_regions &table = detail::perf_region_table();
+    detail::short_lock lock(table.mutex);
+    return table.regions;
+}
+
+/**
+ * @brief
+ *  Writes the per-call average of every available counter for each region to
+ *  stderr, or to `fd`:
+ *
+ *  @code
+ *  Perf regions:   source hardware
+ *         calls  instructions      branches  branch-misses ...  region
+ *            10       10420.0        2051.2            3.1 ...  parse
+ *  @endcode
+ */
+inline void print_perf_regions(int fd = 2)
+{
+    std::vector<perf_region> regions = perf_region_snapshot();
+    if (regions.empty())
+        return;
+    std::uint32_t available = ~std::uint32_t(0);
+    for (const perf_region &region : regions)
+        available &= region.total.available;
+
+    char buf[ASSERTIFY_SINK_BUFFER_SIZE];
+    detail::fixed_writer out(buf, sizeof(buf));
+    auto column = [&](std::string_view text, std::size_t width) {
+        for (std::size_t i = text.size(); i < width; ++i)
+            out.append(' ');
+        out.append(text);
+    };
+    auto average = [&](std::uint64_t total, std::uint64_t calls) {
+        std::uint64_t tenths = total * 10 / calls;
+        char text[24];
+        auto end = std::to_chars(text, text + sizeof(text) - 2, tenths / 10).ptr;
+        *end++ = '.';
+        *end++ = static_cast<char>('0' + tenths % 10);
+        column(std::string_view(text, static_cast<std::size_t>(end - text)), 18);
+    };
+
+    out.append("Perf regions:\tsource ");
+    out.append(perf_source_names[static_cast<unsigned>(regions.back().total.source)]);
+    out.append('\n');
+    column("calls", 14);
+    for (std::size_t i = 0; i < perf_counter_count; ++i)
+        if ((available >> i) & 1)
+            column(perf_counter_names[i], 18);
+    out.append("  region\n");
+    for (const perf_region &region : regions)
+    {
+        char calls[24];
+        auto end = std::to_chars(calls, calls + sizeof(calls), region.calls).ptr;
+        column(std::string_view(calls, static_cast<std::size_t>(end - calls)), 14);
+        for (std::size_t i = 0; i < perf_counter_count; ++i)
+            if ((available >> i) & 1)
+                average(region.total.values[i], region.calls);
+        out.append("  ");
+        out.append(region.name);
+        out.append('\n');
+    }
+    detail::write_report(buf, out.finish(), fd);
+}
+
+/** Forgets every recorded region. */
+inline void reset_perf_regions()
+{
+    detail::perf_regions &table = detail::perf_region_table();
+    detail::short_lock lock(table.mutex);
+    table.regions.clear();
+}
+} // namespace assertify
+
+namespace assertify
+{
+/** Constant description of one `ASSERTIFY_EXPECT` site. */
+struct expect_site
+{
+    const char *expr_str;
+    const char *file;
+    int line;
+    const char *msg;
+};
+
+/** Failures of one `ASSERTIFY_EXPECT` site, aggregated by `assertify::drain`. */
+struct expect_summary
+{
+    const expect_site *site;
+    std::uint64_t count;
+    /** Realtime timestamps of the first and last drained failure. */
+    std::uint64_t first_ns;
+    std::uint64_t last_ns;
+};
+
+namespace detail
+{
+    struct expect_record
+    {
+        const expect_site *site;
+        std::uint64_t timestamp_ns;
+    };
+
+    using expect_ring = thread_ring<expect_record, ASSERTIFY_EXPECT_BUFFER_SIZE>;
+
+    inline short_mutex g_expect_drain_mutex;
+
+    /**
+     * @brief
+     *  Appends a failure of `site` to the calling thread's ring. Takes no
+     *  lock and issues no system call; drops the record if the ring is full.
+     */
+    ASSERTIFY_COLD inline void expect_failed(const expect_site &site)
+    {
+        local_ring<expect_ring>()->push({&site, realtime_ns()});
+    }
+
+    template <class Writer>
+    void write_expect_summary(Writer &writer, const expect_summary &summary)
+    {
+        const expect_site &site = *summary.site;
+        failure f{site.expr_str, site.file, site.line, site.msg};
+        sink_event e{category::soft, summary.count, summary.last_ns, 0};
+        std::uint64_t traced = trace_begin();
+        if (call_handler(f, e))
+            return trace_end(traced, f, category::soft);
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        std::size_t size = 0;
+        if (writer.format() == sink_format::text)
+        {
+            size = format_report(report, sizeof(report), "Expect failed:\t", f);
+            fixed_writer out(report + size, sizeof(report) - size);
+            out.append("Failures:\t");
+            append_decimal(out, summary.count);
+            out.append('\n');
+            size += out.finish();
+        }
+        writer.add(f, e, report, size);
+        trace_end(traced, f, category::soft);
+    }
+
+#if defined(ASSERTIFY_HAS_THREADS)
+    struct expect_flusher
+    {
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stop = false;
+        std::thread thread;
+
+        /** Stops the thread and reports whatever is still pending. */
+        void shut_down();
+
+        // A program that returns from main with the flusher running reports
+        // its pending soft failures here
+        ~expect_flusher() { shut_down(); }
+    };
+
+    /** Created by the first flusher, so programs that never start one carry no exit-time object. */
+    inline expect_flusher &expect_flusher_state()
+    {
+        static expect_flusher flusher;
+        return flusher;
+    }
+#endif
+} // namespace detail
+
+/**
+ * @brief
+ *  Collects the failures recorded by `ASSERTIFY_EXPECT` on all threads since
+ *  the previous call, including threads that have exited, and aggregates them
+ *  per site.
+ */
+inline std::vector<expect_summary> drain()
+{
+    detail::short_lock lock(detail::g_expect_drain_mutex);
+    std::vector<expect_summary> summaries;
+    expect_summary *last = nullptr;
+
+    auto aggregate = [&](const detail::expect_record &record) {
+        if (last == nullptr || last->site != record.site)
+        {
+            last = nullptr;
+            for (auto &summary : summaries)
+            {
+                if (summary.site == record.site)
+                    last = &summary;
+            }
+            if (last == nullptr)
+                last = &summaries.emplace_back(
+                    expect_summary{record.site, 0, record.timestamp_ns, 0});
+        }
+        ++last->count;
+        if (record.timestamp_ns < last->first_ns)
+            last->first_ns = record.timestamp_ns;
+        if (record.timestamp_ns > last->last_ns)
+            last->last_ns = record.timestamp_ns;
+    };
+    auto *ring = detail::g_rings<detail::expect_ring>.load(std::memory_order_acquire);
+    for (; ring != nullptr; ring = ring->next)
+        ring->consume(aggregate);
+    return summaries;
+}
+
+/**
+ * @brief
+ *  Number of `ASSERTIFY_EXPECT` failures dropped because a thread's buffer
+ *  was full.
+ */
+inline std::uint64_t expect_dropped()
+{
+    return detail::ring_dropped<detail::expect_ring>();
+}
+
+/**
+ * @brief
+ *  Drains all pending soft assertion failures and writes one "Expect failed"
+ *  report per site to the sink, batching as many records per `write(2)` as
+ *  `ASSERTIFY_SINK_BUFFER_SIZE` allows.
+ *
+ * @return Number of sites reported.
+ */
+inline std::size_t flush_expectations()
+{
+    std::vector<expect_summary> summaries = drain();
+    detail::sink_writer<ASSERTIFY_SINK_BUFFER_SIZE> writer;
+    for (const auto &summary : summaries)
+        detail::write_expect_summary(writer, summary);
+    writer.flush();
+    return summaries.size();
+}
+
+/**
+ * @brief
+ *  Starts a background thread that calls `flush_expectations` every
+ *  `interval`.
+ *
+ * @return `false` if a flusher is already running, or the platform has no
+ *  threads.
+ */
+inline bool start_expect_flusher(std::chrono::milliseconds interval =
+                                     std::chrono::milliseconds(ASSERTIFY_EXPECT_FLUSH_INTERVAL_MS))
+{
+#if defined(ASSERTIFY_HAS_THREADS)
+    detail::expect_flusher &flusher = detail::expect_flusher_state();
+    if (flusher.thread.joinable())
+        return false;
+    flusher.stop = false;
+    flusher.thread = std::thread([interval] {
+        detail::expect_flusher &flusher = detail::expect_flusher_state();
+        std::unique_lock<std::mutex> lock(flusher.mutex);
+        while (!flusher.wake.wait_for(lock, interval, [&] { return flusher.stop; }))
+        {
+            lock.unlock();
+            flush_expectations();
+            lock.lock();
+        }
+    });
+    return true;
+#else
+    (void)interval;
+    return false;
+#endif
+}
+
+/**
+ * @brief
+ *  Stops the flusher thread and reports whatever is still pending.
+ */
+inline void stop_expect_flusher()
+{
+#if defined(ASSERTIFY_HAS_THREADS)
+    detail::expect_flusher_state().shut_down();
+#else
+    flush_expectations();
+#endif
+}
+
+#if defined(ASSERTIFY_HAS_THREADS)
+namespace detail
+{
+    inline void expect_flusher::shut_down()
+    {
+        if (!thread.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_one();
+        thread.join();
+        flush_expectations();
+    }
+} // namespace detail
+#endif
+} // namespace assertify
 
 /**
  * @brief
@@ -39,25 +3511,551 @@
  * @param msg
  *  Optional message to include in the assertion failure output.
  */
-void __Assert(const char *expr_str, bool expr, const char *file, int line,
-              const char *msg)
+inline void __Assert(const char *expr_str, bool expr, const char *file, int line,
+                     const char *msg)
 {
     if (!expr)
+        assertify::detail::assert_failed({expr_str, file, line, msg});
+}
+
+/**
+ * @brief
+ *  The current source file, relative to `ASSERTIFY_SOURCE_ROOT`, as a
+ *  `static_string` constant.
+ */
+#define ASSERTIFY_STATIC_FILE                                                         \
+    ::assertify::detail::trim_path<::assertify::detail::trimmed_path_size(__FILE__)>( \
+        __FILE__)
+
+/**
+ * @brief
+ *  The current source file, relative to `ASSERTIFY_SOURCE_ROOT`, as a pointer
+ *  to a static null-terminated array. With C++20 the array is an inline
+ *  variable keyed on its contents, so all sites naming the same file share
+ *  one copy across the whole program.
+ */
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+
+namespace assertify
+{
+namespace detail
+{
+    template <auto Value>
+    inline constexpr auto static_storage = Value;
+} // namespace detail
+} // namespace assertify
+
+#define ASSERTIFY_FILE \
+    (::assertify::detail::static_storage<ASSERTIFY_STATIC_FILE>.data())
+
+#else
+
+#define ASSERTIFY_FILE                                                 \
+    ([]() -> const char * {                                            \
+        static constexpr auto assertify_file_ = ASSERTIFY_STATIC_FILE; \
+        return assertify_file_.data();                                 \
+    }())
+
+#endif
+
+/**
+ * @brief
+ *  Evaluates `expr` as a `bool`. With `ASSERTIFY_PROFILE_ENABLED` defined,
+ *  the evaluation is timed and accumulated in the `assertify::site_profile`
+ *  of the site, which is registered under `expr_str`.
+ */
+#if defined(ASSERTIFY_PROFILE_ENABLED)
+
+#if !defined(__cpp_nontype_template_args) || __cpp_nontype_template_args < 201911L
+// The profiles must be constant-initialized to be enumerable before first use
+#error "ASSERTIFY_PROFILE_ENABLED requires C++20"
+#endif
+
+#define ASSERTIFY_PROFILED(expr_str, expr)                                                       \
+    ::assertify::detail::profile_eval(                                                           \
+        []() -> ::assertify::site_profile & {                                                    \
+            __attribute__((section("assertify_profile"), used)) static ::assertify::site_profile \
+                assertify_profile_{expr_str, ASSERTIFY_FILE, __LINE__};                          \
+            return assertify_profile_;                                                           \
+        }(),                                                                                     \
+        [&]() -> bool { return static_cast<bool>(expr); })
+
+#else
+
+#define ASSERTIFY_PROFILED(expr_str, expr) static_cast<bool>(expr)
+
+#endif
+
+/**
+ * @brief
+ *  Evaluates `expr` as a `bool`. With `ASSERTIFY_TRACE_ENABLED` defined, the
+ *  evaluation is timed while `assertify::start_trace` is running.
+ */
+#if defined(ASSERTIFY_TRACING)
+
+#define ASSERTIFY_TIMED(expr_str, expr)                                 \
+    ::assertify::detail::trace_eval(expr_str, ASSERTIFY_FILE, __LINE__, \
+                                    [&]() -> bool { return ASSERTIFY_PROFILED(expr_str, expr); })
+
+#else
+
+#define ASSERTIFY_TIMED(expr_str, expr) ASSERTIFY_PROFILED(expr_str, expr)
+
+#endif
+
+/**
+ * @brief
+ *  Emits a SystemTap/USDT probe `assertify:name` with two arguments, the site
+ *  ID (widened to 64 bits, so that tracers print it unsigned) and a one-byte
+ *  result, in the format of `<sys/sdt.h>` but without depending on it. The
+ *  probe itself is one `nop` whose address is recorded in a `.note.stapsdt`
+ *  note; tracers patch it only while attached.
+ */
+#if defined(ASSERTIFY_USDT_ENABLED) && defined(__ELF__) && defined(__LP64__) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+
+#define ASSERTIFY_USDT(name, site, result)                                                       \
+    __asm__ __volatile__("990: nop\n"                                                            \
+                         ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+                         ".balign 4\n"                                                           \
+                         ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+                         "991: .asciz \"stapsdt\"\n"                                             \
+                         "992: .balign 4\n"                                                      \
+                         "993: .8byte 990b\n"                                                    \
+                         ".8byte _.stapsdt.base\n"                                               \
+                         ".8byte 0\n"                                                            \
+                         ".asciz \"assertify\"\n"                                                \
+                         ".asciz \"" #name "\"\n"                                                \
+                         ".asciz \"8@%0 1@%1\"\n"                                                \
+                         "994: .balign 4\n"                                                      \
+                         ".popsection\n"                                                         \
+                         ".ifndef _.stapsdt.base\n"                                              \
+                         ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+                         ".weak _.stapsdt.base\n"                                                \
+                         ".hidden _.stapsdt.base\n"                                              \
+                         "_.stapsdt.base: .space 1\n"                                            \
+                         ".size _.stapsdt.base, 1\n"                                             \
+                         ".popsection\n"                                                         \
+                         ".endif\n"                                                              \
+                         :                                                                       \
+                         : "nor"(static_cast<std::uint64_t>(site)), "nor"(result))
+
+/**
+ * @brief
+ *  Passes `result` through, firing the `assertify:eval` probe for every
+ *  evaluation and `assertify:fail` for failures.
+ */
+#define ASSERTIFY_PROBE(expr_str, result)                                         \
+    [](bool assertify_result_) -> bool {                                          \
+        constexpr std::uint32_t assertify_site_ =                                 \
+            ::assertify::detail::site_id(ASSERTIFY_STATIC_FILE.data(), __LINE__); \
+        ASSERTIFY_USDT(eval, assertify_site_, assertify_result_);                 \
+        if (!assertify_result_)                                                   \
+            ASSERTIFY_USDT(fail, assertify_site_, assertify_result_);             \
+        return assertify_result_;                                                 \
+    }(result)
+
+#else
+
+#define ASSERTIFY_PROBE(expr_str, result) (result)
+
+#endif
+
+/**
+ * @brief
+ *  Passes `result` through. With `ASSERTIFY_BREADCRUMBS_ENABLED` defined, a
+ *  pass is also recorded in the breadcrumb ring of the calling thread under
+ *  the site ID, and the site is registered under `expr_str`.
+ */
+#if defined(ASSERTIFY_BREADCRUMBS_ENABLED)
+
+#if !defined(__cpp_nontype_template_args) || __cpp_nontype_template_args < 201911L
+// The site descriptions must be constant-initialized to be enumerable
+#error "ASSERTIFY_BREADCRUMBS_ENABLED requires C++20"
+#endif
+
+#define ASSERTIFY_BREADCRUMB(expr_str, result)                                                        \
+    ::assertify::detail::leave_breadcrumb(                                                            \
+        []() -> std::uint32_t {                                                                       \
+            __attribute__((section("assertify_sites"), used)) static constexpr ::assertify::site_info \
+                assertify_site_info_{::assertify::detail::site_id(ASSERTIFY_FILE, __LINE__),          \
+                                     __LINE__, expr_str, ASSERTIFY_FILE};                             \
+            return assertify_site_info_.id;                                                           \
+        }(),                                                                                          \
+        result)
+
+#else
+
+#define ASSERTIFY_BREADCRUMB(expr_str, result) (result)
+
+#endif
+
+/**
+ * @brief
+ *  Evaluates `expr` as a `bool`. With `ASSERTIFY_STATS_ENABLED` defined, the
+ *  result is also counted in the `assertify::site_stats` of the site, which
+ *  is registered under `expr_str`.
+ */
+#if defined(ASSERTIFY_STATS_ENABLED)
+
+#if !defined(__cpp_nontype_template_args) || __cpp_nontype_template_args < 201911L
+// The counters must be constant-initialized to be enumerable before first use
+#error "ASSERTIFY_STATS_ENABLED requires C++20"
+#endif
+
+#define ASSERTIFY_EVAL(expr_str, expr)                                                       \
+    ::assertify::detail::count_result(                                                       \
+        []() -> ::assertify::site_stats & {                                                  \
+            __attribute__((section("assertify_stats"), used)) static ::assertify::site_stats \
+                assertify_stats_{expr_str, ASSERTIFY_FILE, __LINE__};                        \
+            return assertify_stats_;                                                         \
+        }(),                                                                                 \
+        ASSERTIFY_BREADCRUMB(expr_str,                                                       \
+                             ASSERTIFY_PROBE(expr_str, ASSERTIFY_TIMED(expr_str, expr))))
+
+#else
+
+#define ASSERTIFY_EVAL(expr_str, expr) \
+    ASSERTIFY_BREADCRUMB(expr_str, ASSERTIFY_PROBE(expr_str, ASSERTIFY_TIMED(expr_str, expr)))
+
+#endif
+
+#define ASSERT_ABORT(expr, msg) \
+    __Assert(#expr, ASSERTIFY_EVAL(#expr, expr), ASSERTIFY_FILE, __LINE__, (msg))
+
+/**
+ * @brief
+ *  Recoverable check: prints a "Check failed" report if `expr` is false and
+ *  continues. Reports are rate limited per site (see
+ *  `ASSERTIFY_RATE_LIMIT_BURST`), so a check that fails in a hot loop
+ *  collapses into "N more suppressed" summaries instead of flooding stderr.
+ *  Failures still suppressed at exit get one last summary, so `msg` must
+ *  outlive the process, e.g. a string literal.
+ */
+#define ASSERTIFY_CHECK(expr, msg)                                                       \
+    do                                                                                   \
+    {                                                                                    \
+        if (!ASSERTIFY_EVAL(#expr, expr))                                                \
+        {                                                                                \
+            static ::assertify::detail::rate_limiter assertify_limiter_;                 \
+            ::assertify::detail::check_failed(assertify_limiter_, #expr, ASSERTIFY_FILE, \
+                                              __LINE__, (msg));                          \
+        }                                                                                \
+    } while (false)
+
+/**
+ * @brief
+ *  Soft assertion: if `expr` is false, records the failure in a per-thread
+ *  buffer and continues. Nothing is printed until the records are collected
+ *  by `assertify::drain`, `assertify::flush_expectations` or the background
+ *  flusher. `msg` must outlive the process, e.g. a string literal.
+ */
+#define ASSERTIFY_EXPECT(expr, msg)                                                      \
+    do                                                                                   \
+    {                                                                                    \
+        if (!ASSERTIFY_EVAL(#expr, expr))                                                \
+        {                                                                                \
+            static const ::assertify::expect_site assertify_site_{#expr, ASSERTIFY_FILE, \
+                                                                  __LINE__, (msg)};      \
+            ::assertify::detail::expect_failed(assertify_site_);                         \
+        }                                                                                \
+    } while (false)
+
+/**
+ * @brief
+ *  Prints an error message and aborts the program if `expr` is false, like
+ *  `ASSERT_ABORT`, but `msg` must be a string literal.
+ *
+ *  The report lines are concatenated at compile time into one static array
+ *  per assertion site, with a message too long for
+ *  `ASSERTIFY_REPORT_BUFFER_SIZE` shortened to "...". A failure does not
+ *  format them; only the stack trace and breadcrumbs, if enabled, are
+ *  formatted at run time, and the result goes out in one `write(2)` before
+ *  `abort()`.
+ */
+#define ASSERTIFY_ASSERT_ABORT(expr, msg)                                          \
+    do                                                                             \
+    {                                                                              \
+        if (!ASSERTIFY_EVAL(#expr, expr))                                          \
+        {                                                                          \
+            static constexpr auto assertify_report_ =                              \
+                ::assertify::detail::make_report<__LINE__>(msg, #expr,             \
+                                                           ASSERTIFY_STATIC_FILE); \
+            ::assertify::detail::fail({#expr, ASSERTIFY_FILE, __LINE__, msg},      \
+                                      assertify_report_.data(),                    \
+                                      assertify_report_.size(), 0);                \
+        }                                                                          \
+    } while (false)
+
+namespace assertify
+{
+namespace detail
+{
+    template <class T>
+    struct type_identity
+    {
+        using type = T;
+    };
+
+    template <class T>
+    using type_identity_t = typename type_identity<T>::type;
+
+    /**
+     * @brief
+     *  Counts the `{}` placeholders in a format string. `{{` and `}}` are
+     *  escaped braces. Returns -1 if the string is malformed.
+     */
+    constexpr int count_placeholders(const char *fmt)
+    {
+        int count = 0;
+        for (const char *p = fmt; *p != '\0'; ++p)
+        {
+            if (*p == '{')
+            {
+                if (p[1] == '{')
+                    ++p;
+                else if (p[1] == '}')
+                    ++count, ++p;
+                else
+                    return -1;
+            }
+            else if (*p == '}')
+            {
+                if (p[1] != '}')
+                    return -1;
+                ++p;
+            }
+        }
+        return count;
+    }
+
+    // Not constexpr on purpose: reaching it during constant evaluation turns
+    // a bad format string into a compile error that names this function.
+    inline void format_string_placeholder_count_does_not_match_arguments() {}
+
+    /**
+     * @brief
+     *  A format string whose placeholder count is checked against `Args` at
+     *  compile time.
+     */
+    template <class... Args>
+    class format_string
+    {
+    public:
+        template <std::size_t N>
+        ASSERTIFY_CONSTEVAL format_string(const char (&fmt)[N]) : m_str(fmt)
+        {
+            if (count_placeholders(fmt) != static_cast<int>(sizeof...(Args)))
+                format_string_placeholder_count_does_not_match_arguments();
+        }
+
+        constexpr const char *get() const { return m_str; }
+
+    private:
+        const char *m_str;
+    };
+
+    template <class T>
+    void format_value(fixed_writer &out, const T &value)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            value ? out.append("true", 4) : out.append("false", 5);
+        }
+        else if constexpr (std::is_same_v<T, char>)
+        {
+            out.append(value);
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            format_value(out, static_cast<std::underlying_type_t<T>>(value));
+        }
+        else if constexpr (std::is_arithmetic_v<T>)
+        {
+            char tmp[64];
+            auto res = std::to_chars(tmp, tmp + sizeof(tmp), value);
+            out.append(tmp, static_cast<std::size_t>(res.ptr - tmp));
+        }
+        else if constexpr (std::is_convertible_v<const T &, std::string_view>)
+        {
+            if constexpr (std::is_pointer_v<T>)
+            {
+                if (value == nullptr)
+                    return out.append("(null)", 6);
+            }
+            std::string_view sv = value;
+            out.append(sv.data(), sv.size());
+        }
+        else if constexpr (std::is_pointer_v<T> || std::is_null_pointer_v<T>)
+        {
+            char tmp[2 + 2 * sizeof(void *)] = {'0', 'x'};
+            auto res = std::to_chars(tmp + 2, tmp + sizeof(tmp),
+                                     reinterpret_cast<std::uintptr_t>(value), 16);
+            out.append(tmp, static_cast<std::size_t>(res.ptr - tmp));
+        }
+        else
+        {
+            static_assert(sizeof(T) == 0,
+                          "ASSERTIFY_ASSERT_FMT: argument type is not formattable");
+        }
+    }
+
+    /** Type-erased reference to one format argument. */
+    struct format_arg
+    {
+        const void *value;
+        void (*format)(fixed_writer &, const void *);
+    };
+
+    template <class T>
+    void format_erased(fixed_writer &out, const void *value)
+    {
+        format_value(out, *static_cast<const T *>(value));
+    }
+
+    inline std::size_t vformat_to(char *buf, std::size_t cap, const char *fmt,
+                                  const format_arg *args, std::size_t nargs)
     {
-        std::cerr << "Assert failed:\t" << msg << "\n"
-                  << "Expected:\t" << expr_str << "\n"
-                  << "Source:\t\t" << file << ", Line: " << line << "\n";
-        abort();
+        fixed_writer out(buf, cap);
+        std::size_t next = 0;
+        for (const char *p = fmt; *p != '\0'; ++p)
+        {
+            if (p[0] == '{' && p[1] == '}')
+            {
+                if (next < nargs)
+                    args[next].format(out, args[next].value);
+                ++next, ++p;
+            }
+            else if ((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}'))
+            {
+                out.append(*p++);
+            }
+            else
+            {
+                out.append(*p);
+            }
+        }
+        return out.finish();
     }
+} // namespace detail
+
+/**
+ * @brief
+ *  Formats `args` into `buf` according to `fmt`, replacing each `{}` with the
+ *  next argument. Never allocates; output longer than `cap - 1` characters is
+ *  truncated and ends with "...".
+ *
+ * @return Number of characters written, excluding the terminating null.
+ */
+template <class... Args>
+std::size_t format_to(char *buf, std::size_t cap,
+                      detail::format_string<detail::type_identity_t<Args>...> fmt,
+                      const Args &...args)
+{
+    const detail::format_arg erased[sizeof...(Args) + 1] = {
+        {&args, &detail::format_erased<Args>}..., {nullptr, nullptr}};
+    return detail::vformat_to(buf, cap, fmt.get(), erased, sizeof...(Args));
 }
 
-#define ASSERT_ABORT(expr, msg) \
-    __Assert(#expr, (expr), __FILE__, __LINE__, (msg))
+namespace detail
+{
+    /**
+     * @brief
+     *  Copies the bytes of the trivially copyable `args` back to back into
+     *  `buf`, for crash records. Stops at the first argument that does not
+     *  fit.
+     */
+    template <class... Args>
+    std::size_t pack_operands(unsigned char *buf, std::size_t cap, const Args &...args)
+    {
+        std::size_t size = 0;
+        bool full = false;
+        auto pack = [&](const auto &arg) {
+            using T = std::remove_cv_t<std::remove_reference_t<decltype(arg)>>;
+            if constexpr (std::is_trivially_copyable_v<T>)
+            {
+                if (full || size + sizeof(T) > cap)
+                {
+                    full = true;
+                    return;
+                }
+                const auto *bytes = reinterpret_cast<const unsigned char *>(&arg);
+                for (std::size_t i = 0; i < sizeof(T); ++i)
+                    buf[size + i] = bytes[i];
+                size += sizeof(T);
+            }
+        };
+        (pack(args), ...);
+        (void)pack;
+        return size;
+    }
+
+    template <class... Args>
+    [[noreturn]] ASSERTIFY_COLD void
+    assert_fmt_failed(const char *expr_str, const char *file, int line,
+                      format_string<type_identity_t<Args>...> fmt,
+                      const Args &...args)
+    {
+        char msg[ASSERTIFY_FMT_BUFFER_SIZE];
+        const format_arg erased[sizeof...(Args) + 1] = {
+            {&args, &format_erased<Args>}..., {nullptr, nullptr}};
+        vformat_to(msg, sizeof(msg), fmt.get(), erased, sizeof...(Args));
+
+        unsigned char operands[64];
+        failure f{expr_str, file, line, msg, operands,
+                  pack_operands(operands, sizeof(operands), args...)};
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        fail(f, report, format_report(report, sizeof(report), "Assert failed:\t", f), 0);
+    }
+} // namespace detail
+} // namespace assertify
+
+/**
+ * @brief
+ *  Like `ASSERT_ABORT`, but the message is a format string whose `{}`
+ *  placeholders are replaced by the trailing arguments.
+ *
+ *  The placeholder count is checked against the arguments at compile time.
+ *  The arguments are only evaluated when `expr` is false and are formatted
+ *  into a fixed stack buffer of `ASSERTIFY_FMT_BUFFER_SIZE` bytes, so a
+ *  passing check costs nothing beyond the test of `expr`.
+ *
+ * @code
+ *  ASSERTIFY_ASSERT_FMT(n <= cap, "size {} > cap {}", n, cap);
+ * @endcode
+ */
+#define ASSERTIFY_ASSERT_FMT(expr, ...)                                             \
+    do                                                                              \
+    {                                                                               \
+        if (!ASSERTIFY_EVAL(#expr, expr))                                           \
+        {                                                                           \
+            ::assertify::detail::assert_fmt_failed(#expr, ASSERTIFY_FILE, __LINE__, \
+                                                   __VA_ARGS__);                    \
+        }                                                                           \
+    } while (false)
 
 #ifndef __CPP_AsertionError_Class
 
 #include <exception>
 
+/**
+ * @brief
+ *  Capacity, including the terminating null, of the inline buffers in which
+ *  `AssertionError` stores its message, expression and file name. Longer
+ *  strings are truncated and terminated with "...".
+ */
+#ifndef ASSERTIFY_ERROR_MSG_SIZE
+#define ASSERTIFY_ERROR_MSG_SIZE 256
+#endif
+
+#ifndef ASSERTIFY_ERROR_EXPR_SIZE
+#define ASSERTIFY_ERROR_EXPR_SIZE 128
+#endif
+
+#ifndef ASSERTIFY_ERROR_FILE_SIZE
+#define ASSERTIFY_ERROR_FILE_SIZE 128
+#endif
+
 /**
  * @class AssertionError
  *
@@ -68,12 +4066,19 @@ void __Assert(const char *expr_str, bool expr, const char *file, int line,
  *  information about the failed assertion, including the expression, file, and
  *  line number where the assertion occurred, as well as a user-defined message.
  *
+ *  All strings are copied into fixed-size buffers inside the object, so an
+ *  error built from a temporary or formatted message stays valid wherever it
+ *  is caught, constructing one never allocates, and copying one cannot throw.
+ *
  *  The `what()` method can be used to get the user-defined message as a `const
  *  char*`.
  */
 class AssertionError : public std::exception
 {
 public:
+    /** Constructs an empty error, used as storage by the `longjmp` handler. */
+    AssertionError() noexcept = default;
+
     /**
      * @brief Constructs a new AssertionError object.
      * @param expr_str String representation of the failed expression.
@@ -83,12 +4088,32 @@ public:
      * @param msg User-defined message describing the failed assertion.
      */
     AssertionError(const char *expr_str, bool expr, const char *file,
-                   int line, const char *msg)
-        : m_expr_str(expr_str),
-          m_expr(expr),
-          m_file(file),
-          m_line(line),
-          m_msg(msg) {}
+                   int line, const char *msg) noexcept
+        : m_expr(expr),
+          m_line(line)
+    {
+        copy(m_expr_str, sizeof(m_expr_str), expr_str);
+        copy(m_file, sizeof(m_file), file);
+        copy(m_msg, sizeof(m_msg), msg);
+    }
+
+    /**
+     * @brief
+     *  Constructs a new AssertionError object whose message is formatted from
+     *  `fmt` and `args` directly into the inline message buffer, as with
+     *  `assertify::format_to`.
+     */
+    template <class... Args>
+    AssertionError(const char *expr_str, bool expr, const char *file, int line,
+                   assertify::detail::format_string<assertify::detail::type_identity_t<Args>...> fmt,
+                   const Args &...args) noexcept
+        : m_expr(expr),
+          m_line(line)
+    {
+        copy(m_expr_str, sizeof(m_expr_str), expr_str);
+        copy(m_file, sizeof(m_file), file);
+        assertify::format_to(m_msg, sizeof(m_msg), fmt, args...);
+    }
 
     /**
      * @brief Returns the user-defined message for the failed assertion.
@@ -106,20 +4131,45 @@ public:
     int line() const { return m_line; }
 
 private:
+    static void copy(char *dst, std::size_t cap, const char *src) noexcept
+    {
+        assertify::detail::fixed_writer out(dst, cap);
+        if (src != nullptr)
+            out.append(src);
+        out.finish();
+    }
+
     /** String representation of the failed expression. */
-    const char *m_expr_str;
+    char m_expr_str[ASSERTIFY_ERROR_EXPR_SIZE] = {};
     /** Result of the failed expression (should be `false`). */
-    bool m_expr;
+    bool m_expr = false;
     /** Name of the file where the assertion occurred. */
-    const char *m_file;
+    char m_file[ASSERTIFY_ERROR_FILE_SIZE] = {};
     /** Line number where the assertion occurred. */
-    int m_line;
+    int m_line = 0;
     /** User-defined message describing the failed assertion. */
-    const char *m_msg;
+    char m_msg[ASSERTIFY_ERROR_MSG_SIZE] = {};
 };
 
-void __Assert_w_Err_Class(const char *expr_str, bool expr, const char *file, int line,
-                          const char *msg)
+static_assert(std::is_nothrow_copy_constructible<AssertionError>::value,
+              "AssertionError must be nothrow copy constructible");
+
+namespace assertify
+{
+namespace detail
+{
+    /** Reports an `AssertionError` caught by `ASSERTIFY_ASSERT_EXCEPTION` and exits with status 1. */
+    [[noreturn]] ASSERTIFY_COLD inline void error_failed(const AssertionError &e)
+    {
+        failure f{e.expr_str(), e.file(), e.line(), e.what()};
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        fail(f, report, format_report(report, sizeof(report), "Assertion failed: ", f), 1);
+    }
+} // namespace detail
+} // namespace assertify
+
+inline void __Assert_w_Err_Class(const char *expr_str, bool expr, const char *file, int line,
+                                 const char *msg)
 {
     if (!expr)
     {
@@ -134,7 +4184,18 @@ void __Assert_w_Err_Class(const char *expr_str, bool expr, const char *file, int
 namespace
 {
     static std::jmp_buf s_error_handler;
+    static AssertionError s_error_storage;
     static AssertionError *s_error = nullptr;
+
+    /** Stores the error and jumps back to the assertion site; kept out of line and cold. */
+    [[noreturn]] ASSERTIFY_COLD inline void long_jump_failed(const char *expr_str,
+                                                             const char *file, int line,
+                                                             const char *msg)
+    {
+        s_error_storage = AssertionError(expr_str, false, file, line, msg);
+        s_error = &s_error_storage;
+        std::longjmp(s_error_handler, 1);
+    }
 } // anonymous namespace
 
 /**
@@ -146,10 +4207,10 @@ namespace
  * @param msg User-defined message describing the failed assertion.
  *
  * This function is called when an assertion fails in the program. It constructs
- * a new `AssertionError` object and stores it in a global variable, then calls
- * `longjmp` to jump back to the `setjmp` call in the calling function. The
- * `setjmp` function should be called in a block of code that is prepared to
- * handle the assertion failure.
+ * an `AssertionError` object in static storage and points a global variable at
+ * it, then calls `longjmp` to jump back to the `setjmp` call in the calling
+ * function. The `setjmp` function should be called in a block of code that is
+ * prepared to handle the assertion failure.
  *
  * @warning
  *  Using longjmp to handle an assertion failure can be an effective solution in some
@@ -168,51 +4229,41 @@ namespace
  *  Finally, longjmp is not exception-safe, which means that it can leave the program in an undefined
  *  state if an exception is thrown between the setjmp and longjmp calls.
  */
-void __Assert_Long_Jmp(const char *expr_str, bool expr, const char *file, int line,
-                       const char *msg)
+static inline void __Assert_Long_Jmp(const char *expr_str, bool expr, const char *file,
+                                     int line, const char *msg)
 {
     if (!expr)
-    {
-        s_error = new AssertionError(expr_str, expr, file, line, msg);
-        std::longjmp(s_error_handler, 1);
-    }
+        long_jump_failed(expr_str, file, line, msg);
 }
 
-#define ASSERTIFY_ASSERT_EXCEPTION(expr, msg)                            \
-    do                                                                   \
-    {                                                                    \
-        if (setjmp(s_error_handler) == 0)                                \
-        {                                                                \
-            __Assert_Long_Jmp(#expr, (expr), __FILE__, __LINE__, (msg)); \
-        }                                                                \
-        else                                                             \
-        {                                                                \
-            std::cerr << "Assertion failed: " << s_error->what() << "\n" \
-                      << "Expected:\t" << s_error->expr_str() << "\n"    \
-                      << "Source:\t\t" << s_error->file() << ", Line: "  \
-                      << s_error->line() << "\n";                        \
-            delete s_error;                                              \
-            std::exit(1);                                                \
-        }                                                                \
+#define ASSERTIFY_ASSERT_EXCEPTION(expr, msg)                                               \
+    do                                                                                      \
+    {                                                                                       \
+        if (setjmp(s_error_handler) == 0)                                                   \
+        {                                                                                   \
+            __Assert_Long_Jmp(#expr, ASSERTIFY_EVAL(#expr, expr), ASSERTIFY_FILE, __LINE__, \
+                              (msg));                                                       \
+        }                                                                                   \
+        else                                                                                \
+        {                                                                                   \
+            ::assertify::detail::error_failed(*s_error);                                    \
+        }                                                                                   \
     } while (false)
 
 #else
 
-#define ASSERTIFY_ASSERT_EXCEPTION(expr, msg)                               \
-    do                                                                      \
-    {                                                                       \
-        try                                                                 \
-        {                                                                   \
-            __Assert_w_Err_Class(#expr, (expr), __FILE__, __LINE__, (msg)); \
-        }                                                                   \
-        catch (const AssertionError &e)                                     \
-        {                                                                   \
-            std::cerr << "Assertion failed: " << e.what() << "\n"           \
-                      << "Expected:\t" << e.expr_str() << "\n"              \
-                      << "Source:\t\t" << e.file() << ", Line: "            \
-                      << e.line() << "\n";                                  \
-            std::exit(1);                                                   \
-        }                                                                   \
+#define ASSERTIFY_ASSERT_EXCEPTION(expr, msg)                                                  \
+    do                                                                                         \
+    {                                                                                          \
+        try                                                                                    \
+        {                                                                                      \
+            __Assert_w_Err_Class(#expr, ASSERTIFY_EVAL(#expr, expr), ASSERTIFY_FILE, __LINE__, \
+                                 (msg));                                                       \
+        }                                                                                      \
+        catch (const AssertionError &e)                                                        \
+        {                                                                                      \
+            ::assertify::detail::error_failed(e);                                              \
+        }                                                                                      \
     } while (false)
 
 #endif // ASSERTIFY_LONG_JMP
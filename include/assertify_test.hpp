@@ -0,0 +1,2146 @@
+/**
+ * @file assertify_test.hpp
+ *
+ * @brief
+ *  Test support for code that uses assertify. Death tests run a statement in
+ *  a forked child and check how the child ended and what it wrote to stderr,
+ *  so an assertion that is supposed to fire can be told apart from a crash.
+ *  Children run in parallel through a bounded `death_pool`.
+ *
+ *  Tests defined with `ASSERTIFY_TEST(name)` are collected from a linker
+ *  section, without static constructors, and run by `assertify::test_main`:
+ *  in parallel, sharded, filtered and longest first. Results stream to the
+ *  console, TAP and JSON lines as tests finish, and end up in JUnit XML.
+ */
+
+#ifndef ASSERTIFY_TEST_HPP_c4n8w1
+#define ASSERTIFY_TEST_HPP_c4n8w1
+
+#include "assertify.hpp"
+
+#if !defined(__unix__) && !defined(__APPLE__)
+#error "assertify_test.hpp requires fork(2)"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <poll.h>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace assertify
+{
+/** How a death test child is expected to end. */
+struct exit_status
+{
+    enum class kind
+    {
+        /** Killed by any signal, or exited with a non-zero status. */
+        died,
+        /** Exited with status `value`. */
+        exited,
+        /** Killed by signal `value`. */
+        killed,
+    };
+
+    kind expected;
+    int value;
+
+    /** Returns whether a status from `waitpid` matches. */
+    bool matches(int status) const
+    {
+        switch (expected)
+        {
+        case kind::exited:
+            return WIFEXITED(status) && WEXITSTATUS(status) == value;
+        case kind::killed:
+            return WIFSIGNALED(status) && WTERMSIG(status) == value;
+        default:
+            return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+    }
+};
+
+inline exit_status died() { return {exit_status::kind::died, 0}; }
+inline exit_status exited_with(int code) { return {exit_status::kind::exited, code}; }
+inline exit_status killed_by(int signal) { return {exit_status::kind::killed, signal}; }
+
+namespace detail
+{
+    inline std::atomic<std::uint64_t> g_test_failures{0};
+    // Failures on this thread, so the runner can tell which test they belong to
+    inline thread_local std::uint64_t t_test_failures = 0;
+
+    // Calls to `operator new` in the process and on this thread, counted
+    // by ASSERTIFY_TEST_COUNT_ALLOCATIONS
+    inline std::atomic<std::uint64_t> g_allocations{0};
+    inline thread_local std::uint64_t t_allocations = 0;
+
+    inline void count_allocation()
+    {
+        g_allocations.fetch_add(1, std::memory_order_relaxed);
+        ++t_allocations;
+    }
+
+    /** Constant description of one death test site. */
+    struct death_test
+    {
+        const char *stmt;
+        const char *file;
+        int line;
+        exit_status expected;
+        const char *regex;
+    };
+
+    inline std::string describe_status(int status)
+    {
+        if (WIFSIGNALED(status))
+            return "killed by signal " + std::to_string(WTERMSIG(status)) + " (" +
+                   strsignal(WTERMSIG(status)) + ")";
+        return "exited with " + std::to_string(WEXITSTATUS(status));
+    }
+
+    inline std::string describe_expected(const exit_status &expected)
+    {
+        switch (expected.expected)
+        {
+        case exit_status::kind::exited:
+            return "exits with " + std::to_string(expected.value);
+        case exit_status::kind::killed:
+            return "killed by signal " + std::to_string(expected.value) + " (" +
+                   strsignal(expected.value) + ")";
+        default:
+            return "dies";
+        }
+    }
+
+    /** Appends `output` to a report, one line per line of output, tab-indented. */
+    inline void append_output(std::string &report, const std::string &output)
+    {
+        std::size_t begin = 0;
+        while (begin < output.size())
+        {
+            std::size_t end = output.find('\n', begin);
+            if (end == std::string::npos)
+                end = output.size();
+            report += "\t\t";
+            report.append(output, begin, end - begin);
+            report += '\n';
+            begin = end + 1;
+        }
+        if (output.empty())
+            report += "\t\t(empty)\n";
+    }
+
+    /** Reports a death test whose child did not end as expected, and counts it. */
+    ASSERTIFY_COLD inline void death_test_failed(const death_test &test, int status,
+                                                 const std::string &output, const char *why)
+    {
+        g_test_failures.fetch_add(1, std::memory_order_relaxed);
+        ++t_test_failures;
+        std::string report = "Death test failed:\t";
+        report += test.stmt;
+        report += "\nExpected:\t" + describe_expected(test.expected) +
+                  ", stderr matching \"" + test.regex + "\"\nActual:\t\t" +
+                  describe_status(status) + ", " + why + "\nSource:\t\t" + test.file +
+                  ", Line: " + std::to_string(test.line) + "\nStderr:";
+        append_output(report, output);
+        write_report(report.data(), report.size());
+    }
+
+    inline void check_death(const death_test &test, int status, const std::string &output)
+    {
+        if (!test.expected.matches(status))
+            return death_test_failed(test, status, output, "status differs");
+        try
+        {
+            if (!std::regex_search(output, std::regex(test.regex)))
+                death_test_failed(test, status, output, "stderr does not match");
+        }
+        catch (const std::regex_error &e)
+        {
+            death_test_failed(test, status, output, e.what());
+        }
+    }
+} // namespace detail
+} // namespace assertify
+
+// Defined by ASSERTIFY_TEST_COUNT_ALLOCATIONS.
+extern "C" const bool assertify_counts_allocations __attribute__((weak));
+
+namespace assertify
+{
+/** Whether `operator new` calls are counted, see ASSERTIFY_TEST_COUNT_ALLOCATIONS. */
+inline bool counts_allocations()
+{
+    return &assertify_counts_allocations != nullptr;
+}
+
+/** Number of death tests, and later other test checks, that failed so far. */
+inline std::uint64_t test_failures()
+{
+    return detail::g_test_failures.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief
+ *  Runs death tests in at most `jobs` children at a time. While a pool is
+ *  alive, `ASSERTIFY_EXPECT_DEATH` and `ASSERTIFY_EXPECT_EXIT` on the same
+ *  thread fork their child and return without waiting for it; the results
+ *  are checked as children finish, and all of them by `wait` or the
+ *  destructor. Without a pool, each death test waits for its child.
+ *
+ *  The child starts from a copy of the caller, so the statement may use
+ *  locals of the enclosing function even though it is checked later.
+ *
+ *  @code
+ *  assertify::death_pool pool;
+ *  for (int bad : {-1, -2, -3})
+ *      ASSERTIFY_EXPECT_DEATH(parse(bad), "Assert failed:\tinput is negative");
+ *  pool.wait();
+ *  @endcode
+ */
+class death_pool
+{
+public:
+    explicit death_pool(std::size_t jobs = std::thread::hardware_concurrency())
+        : m_jobs(jobs == 0 ? 1 : jobs), m_previous(current())
+    {
+        current() = this;
+    }
+
+    ~death_pool()
+    {
+        wait();
+        current() = m_previous;
+    }
+
+    death_pool(const death_pool &) = delete;
+    death_pool &operator=(const death_pool &) = delete;
+
+    /** Forks a child that runs `stmt` and must end as `test` expects. */
+    template <class Fn>
+    void run(const detail::death_test &test, Fn &&stmt)
+    {
+        while (m_children.size() >= m_jobs)
+            reap();
+
+        int fds[2];
+        if (::pipe(fds) != 0)
+            return detail::death_test_failed(test, 0, std::strerror(errno), "pipe failed");
+        ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        std::fflush(nullptr);
+        std::cout.flush();
+        pid_t pid = ::fork();
+        if (pid == 0)
+        {
+            ::dup2(fds[1], 2);
+            ::close(fds[0]);
+            ::close(fds[1]);
+            current() = nullptr;
+            stmt();
+            // Surviving the statement fails the test; skip the parent's exit handlers
+            std::fflush(nullptr);
+            ::_exit(0);
+        }
+        ::close(fds[1]);
+        if (pid < 0)
+        {
+            ::close(fds[0]);
+            return detail::death_test_failed(test, 0, std::strerror(errno), "fork failed");
+        }
+        m_children.push_back({pid, fds[0], test, {}});
+    }
+
+    /** Waits for every running child and checks its result. */
+    void wait()
+    {
+        while (!m_children.empty())
+            reap();
+    }
+
+    std::size_t jobs() const { return m_jobs; }
+
+    /** The pool death tests on the calling thread go to, if any. */
+    static death_pool *&current()
+    {
+        static thread_local death_pool *pool = nullptr;
+        return pool;
+    }
+
+private:
+    struct child
+    {
+        pid_t pid;
+        int fd;
+        detail::death_test test;
+        std::string output;
+    };
+
+    /** Reads the children's stderr until at least one of them finishes. */
+    void reap()
+    {
+        std::vector<pollfd> fds;
+        for (const child &c : m_children)
+            fds.push_back({c.fd, POLLIN, 0});
+        if (::poll(fds.data(), fds.size(), -1) < 0)
+            return;
+        for (std::size_t i = fds.size(); i-- > 0;)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            child &c = m_children[i];
+            char buf[4096];
+            ssize_t n = ::read(c.fd, buf, sizeof(buf));
+            if (n > 0)
+            {
+                c.output.append(buf, static_cast<std::size_t>(n));
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            ::close(c.fd);
+            int status = 0;
+            while (::waitpid(c.pid, &status, 0) < 0 && errno == EINTR)
+            {
+            }
+            detail::check_death(c.test, status, c.output);
+            m_children.erase(m_children.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+    }
+
+    std::vector<child> m_children;
+    std::size_t m_jobs;
+    death_pool *m_previous;
+};
+
+namespace detail
+{
+    template <class Fn>
+    void expect_death(const death_test &test, Fn &&stmt)
+    {
+        if (death_pool *pool = death_pool::current())
+            return pool->run(test, stmt);
+        death_pool pool(1);
+        pool.run(test, stmt);
+    }
+} // namespace detail
+
+/** A test defined with `ASSERTIFY_TEST`. */
+struct alignas(32) test_case
+{
+    const char *name;
+    const char *file;
+    int line;
+    void (*fn)();
+};
+
+} // namespace assertify
+
+// Provided by the linker for the section that holds the registered tests.
+extern "C" const assertify::test_case __start_assertify_tests[] __attribute__((weak, visibility("hidden")));
+extern "C" const assertify::test_case __stop_assertify_tests[] __attribute__((weak, visibility("hidden")));
+
+namespace assertify
+{
+/** Every test defined with `ASSERTIFY_TEST` in the program, ordered by name. */
+inline std::vector<const test_case *> registered_tests()
+{
+    std::vector<const test_case *> tests;
+    if (__start_assertify_tests != nullptr)
+    {
+        for (const test_case *test = __start_assertify_tests; test != __stop_assertify_tests; ++test)
+            tests.push_back(test);
+    }
+    std::stable_sort(tests.begin(), tests.end(), [](const test_case *a, const test_case *b) {
+        return std::strcmp(a->name, b->name) < 0;
+    });
+    return tests;
+}
+
+/** Which tests `test_main` runs and how; each field has a command line flag. */
+struct test_options
+{
+    /** --filter=GLOB[:GLOB...]: names to run, `-GLOB` excludes. Empty runs all. */
+    std::string filter;
+    /** --shard=INDEX/COUNT: run every COUNT-th selected test, starting at INDEX. */
+    std::size_t shard_index = 0;
+    std::size_t shard_count = 1;
+    /** --jobs=N: tests running at the same time. */
+    std::size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    /** --threads: run on a work-stealing thread pool instead of one child per test. */
+    bool threads = false;
+    /** --list: print the selected tests in run order instead of running them. */
+    bool list = false;
+    /** --cache=FILE: results of past runs, for ordering and skipping. Empty for none. */
+    std::string cache_path;
+    /** --failed-first: run the tests that failed last time before the others. */
+    bool failed_first = false;
+    /** --only-changed: skip tests that passed last time and whose code is unchanged. */
+    bool only_changed = false;
+    /** --timeout-ms=N: wall-clock limit per test, 0 for none. */
+    std::uint64_t timeout_ms = 60000;
+    /** --max-rss-mb=N: peak resident set a forked test adds, in KiB; 0 for none. */
+    std::uint64_t max_rss_kb = 0;
+    /** --max-allocations=N: `operator new` calls per test, 0 for none. */
+    std::uint64_t max_allocations = 0;
+    /** --junit=FILE: JUnit XML report, written when the run ends. */
+    std::string junit_path;
+    /** --tap=FILE: TAP stream, a line per test as it finishes. */
+    std::string tap_path;
+    /** --jsonl=FILE: JSON lines stream, an object per test as it finishes. */
+    std::string jsonl_path;
+    /** Test suite name in the JUnit XML; the program name under `test_main`. */
+    std::string suite_name = "assertify";
+};
+
+struct test_result
+{
+    const test_case *test;
+    bool passed;
+    std::uint64_t duration_ns;
+    /** Why the test failed, e.g. "killed by signal 6 (Aborted)". */
+    std::string reason;
+    /** stdout and stderr of the test, when it ran in a child. */
+    std::string output;
+    /** Whether the watchdog stopped the test at `test_options::timeout_ms`. */
+    bool timed_out;
+    /** Peak resident set the test's child added to what it inherited at fork, in KiB; 0 on the thread pool. */
+    std::uint64_t peak_rss_kb;
+    /** `operator new` calls made by the test, if `counts_allocations()`. */
+    std::uint64_t allocations;
+};
+
+/** Outcome of the last run of a test, as kept in the result cache. */
+enum class test_status : std::uint32_t
+{
+    unknown,
+    passed,
+    failed,
+};
+
+/** One test in the result cache file. */
+struct test_cache_entry
+{
+    /** Hash of the test name; 0 marks a free slot. */
+    std::atomic<std::uint64_t> name_hash;
+    /** Hash of the test's code when it last ran, 0 if it could not be computed. */
+    std::uint64_t code_hash;
+    std::uint64_t duration_ns;
+    test_status status;
+    std::uint32_t runs;
+    /** Test name, truncated, for inspecting the file. */
+    char name[48];
+};
+
+/** Header of the result cache file, followed by `capacity` entries. */
+struct test_cache_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t entry_size;
+    /** Number of entries, a power of two. */
+    std::uint32_t capacity;
+    std::uint32_t reserved;
+};
+
+inline constexpr char test_cache_magic[8] = {'A', 'S', 'R', 'T', 'T', 'E', 'S', 'T'};
+inline constexpr std::uint32_t test_cache_version = 1;
+
+namespace detail
+{
+    inline std::uint64_t fnv1a(const void *data, std::size_t size,
+                               std::uint64_t hash = 14695981039346656037ull)
+    {
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        for (std::size_t i = 0; i < size; ++i)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    inline std::uint64_t name_hash(const char *name)
+    {
+        std::uint64_t hash = fnv1a(name, std::strlen(name));
+        return hash == 0 ? 1 : hash;
+    }
+
+#if defined(__linux__) && defined(ASSERTIFY_HAS_EHDR_START)
+    /**
+     * @brief
+     *  Layout-independent hashes of the code and data in an executable
+     *  linked with `--emit-relocs`, which keeps the relocations of every
+     *  section. A region is a sized symbol, or for an unsized label such as
+     *  a string literal the bytes up to the next symbol or the next address
+     *  another relocation refers to. Its local hash covers its bytes with
+     *  every relocated field zeroed, and for each relocation the content of
+     *  the region it refers to, or the name of an undefined or thread-local
+     *  symbol. Nothing depends on addresses, so moving code or data around
+     *  changes no hash.
+     */
+    class elf_code_hasher
+    {
+    public:
+        elf_code_hasher(const char *image, std::size_t size)
+            : m_image(image), m_size(size), m_ehdr(reinterpret_cast<const ElfW(Ehdr) *>(image)),
+              m_shdrs(reinterpret_cast<const ElfW(Shdr) *>(image + m_ehdr->e_shoff))
+        {
+            const ElfW(Shdr) *symtab = nullptr;
+            for (std::size_t i = 0; i < m_ehdr->e_shnum; ++i)
+            {
+                if (m_shdrs[i].sh_type == SHT_SYMTAB && m_shdrs[i].sh_entsize == sizeof(ElfW(Sym)) &&
+                    in_file(m_shdrs[i].sh_offset, m_shdrs[i].sh_size) && m_shdrs[i].sh_link < m_ehdr->e_shnum)
+                {
+                    symtab = &m_shdrs[i];
+                    m_symtab_index = i;
+                }
+            }
+            if (symtab == nullptr)
+                return;
+            m_syms = reinterpret_cast<const ElfW(Sym) *>(image + symtab->sh_offset);
+            m_sym_count = symtab->sh_size / sizeof(ElfW(Sym));
+            m_strtab = image + m_shdrs[symtab->sh_link].sh_offset;
+            for (std::size_t n = 0; n < m_sym_count; ++n)
+            {
+                const ElfW(Sym) &sym = m_syms[n];
+                unsigned type = ELF64_ST_TYPE(sym.st_info);
+                if (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE)
+                    continue;
+                if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= m_ehdr->e_shnum ||
+                    !(m_shdrs[sym.st_shndx].sh_flags & SHF_ALLOC))
+                    continue;
+                m_symbols.push_back({sym.st_value, sym.st_size, sym.st_shndx});
+            }
+            std::sort(m_symbols.begin(), m_symbols.end(),
+                      [](const symbol &a, const symbol &b) { return a.value < b.value; });
+
+            // Only the static relocations kept by --emit-relocs refer to .symtab
+            for (std::size_t i = 0; i < m_ehdr->e_shnum; ++i)
+            {
+                const ElfW(Shdr) &rela = m_shdrs[i];
+                if (rela.sh_type != SHT_RELA || rela.sh_link != m_symtab_index ||
+                    rela.sh_entsize != sizeof(ElfW(Rela)) || rela.sh_info >= m_ehdr->e_shnum ||
+                    !(m_shdrs[rela.sh_info].sh_flags & SHF_ALLOC) || !in_file(rela.sh_offset, rela.sh_size))
+                    continue;
+                std::string_view name = section_name(rela.sh_info);
+                if (name.substr(0, 9) == ".eh_frame" || name == ".gcc_except_table")
+                    continue;
+                const auto *entries = reinterpret_cast<const ElfW(Rela) *>(image + rela.sh_offset);
+                for (std::size_t n = 0; n < rela.sh_size / sizeof(ElfW(Rela)); ++n)
+                {
+                    const ElfW(Rela) &r = entries[n];
+                    if (ELF64_R_SYM(r.r_info) < m_sym_count)
+                        m_relocs.push_back({r.r_offset, static_cast<std::uint32_t>(ELF64_R_TYPE(r.r_info)),
+                                            static_cast<std::uint32_t>(ELF64_R_SYM(r.r_info)),
+                                            static_cast<std::int64_t>(r.r_addend)});
+                }
+            }
+            std::sort(m_relocs.begin(), m_relocs.end(),
+                      [](const reloc &a, const reloc &b) { return a.offset < b.offset; });
+
+            // Addresses referred to through a section symbol, such as string
+            // literals, end the unsized region before them
+            for (const reloc &r : m_relocs)
+            {
+                const ElfW(Sym) &sym = m_syms[r.sym];
+                if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION)
+                    m_targets.push_back(sym.st_value + static_cast<std::uint64_t>(r.addend + pc_bias(r.type)));
+            }
+            std::sort(m_targets.begin(), m_targets.end());
+            m_targets.erase(std::unique(m_targets.begin(), m_targets.end()), m_targets.end());
+        }
+
+        /** Whether the executable kept its relocations, i.e. was linked with --emit-relocs. */
+        bool has_relocations() const { return !m_relocs.empty(); }
+
+        /**
+         * Hash of every region reachable through relocations from the one at
+         * `vaddr`, independent of the order they were found in.
+         */
+        std::uint64_t reachable(std::uint64_t vaddr)
+        {
+            std::vector<std::uint64_t> hashes;
+            std::unordered_set<std::uint64_t> seen;
+            std::vector<region> pending{find_region(vaddr)};
+            std::uint64_t root = local(pending.back()).hash;
+            while (!pending.empty())
+            {
+                region r = pending.back();
+                pending.pop_back();
+                if (r.end == r.begin || !seen.insert(r.begin).second)
+                    continue;
+                const local_hash &h = local(r);
+                hashes.push_back(h.hash);
+                pending.insert(pending.end(), h.targets.begin(), h.targets.end());
+            }
+            std::sort(hashes.begin(), hashes.end());
+            return fnv1a(hashes.data(), hashes.size() * sizeof(hashes[0]), root);
+        }
+
+    private:
+        struct symbol
+        {
+            std::uint64_t value, size;
+            std::size_t section;
+        };
+        struct reloc
+        {
+            std::uint64_t offset;
+            std::uint32_t type, sym;
+            std::int64_t addend;
+        };
+        struct region
+        {
+            std::uint64_t begin, end;
+            std::size_t section;
+        };
+        struct local_hash
+        {
+            std::uint64_t hash;
+            std::vector<region> targets;
+        };
+
+        bool in_file(std::uint64_t offset, std::uint64_t size) const
+        {
+            return offset <= m_size && size <= m_size - offset;
+        }
+
+        std::string_view section_name(std::size_t index) const
+        {
+            return m_image + m_shdrs[m_ehdr->e_shstrndx].sh_offset + m_shdrs[index].sh_name;
+        }
+
+        /** Bytes of the relocated field; 8 for absolute and 64-bit relative relocations. */
+        std::size_t field_size(std::uint32_t type) const
+        {
+            if (m_ehdr->e_machine == EM_X86_64)
+                return type == R_X86_64_64 || type == R_X86_64_PC64 || type == R_X86_64_GOTOFF64 ? 8 : 4;
+            if (m_ehdr->e_machine == EM_AARCH64)
+                return type == R_AARCH64_ABS64 || type == R_AARCH64_PREL64 ? 8 : 4;
+            return 4;
+        }
+
+        /** What x86-64 PC-relative addends leave out: the field sits 4 bytes before the next instruction. */
+        std::int64_t pc_bias(std::uint32_t type) const
+        {
+            bool pc_relative = type == R_X86_64_PC32 || type == R_X86_64_PLT32 || type == R_X86_64_GOTPCREL ||
+                               type == R_X86_64_GOTPCRELX || type == R_X86_64_REX_GOTPCRELX;
+            return m_ehdr->e_machine == EM_X86_64 && pc_relative ? 4 : 0;
+        }
+
+        std::size_t section_of(std::uint64_t vaddr) const
+        {
+            for (std::size_t i = 1; i < m_ehdr->e_shnum; ++i)
+            {
+                const ElfW(Shdr) &s = m_shdrs[i];
+                if ((s.sh_flags & SHF_ALLOC) && vaddr >= s.sh_addr && vaddr < s.sh_addr + s.sh_size)
+                    return i;
+            }
+            return 0;
+        }
+
+        /** The sized symbol around `vaddr`, or the bytes from `vaddr` to the next symbol or referenced address. */
+        region find_region(std::uint64_t vaddr) const
+        {
+            std::size_t section = section_of(vaddr);
+            if (section == 0)
+                return {vaddr, vaddr, 0};
+            const ElfW(Shdr) &s = m_shdrs[section];
+            auto next = std::upper_bound(m_symbols.begin(), m_symbols.end(), vaddr,
+                                         [](std::uint64_t v, const symbol &sym) { return v < sym.value; });
+            for (auto it = next; it != m_symbols.begin() && next - it < 16;)
+            {
+                --it;
+                if (it->size != 0 && it->section == section && vaddr < it->value + it->size)
+                    return {it->value, it->value + it->size, section};
+            }
+            std::uint64_t end = std::min<std::uint64_t>(s.sh_addr + s.sh_size, vaddr + 256);
+            if (next != m_symbols.end())
+                end = std::min(end, next->value);
+            auto target = std::upper_bound(m_targets.begin(), m_targets.end(), vaddr);
+            if (target != m_targets.end())
+                end = std::min(end, *target);
+            return {vaddr, end, section};
+        }
+
+        /** Bytes of `r` with the relocated fields zeroed; empty for sections without file data. */
+        std::string zeroed(const region &r) const
+        {
+            const ElfW(Shdr) &s = m_shdrs[r.section];
+            if (s.sh_type == SHT_NOBITS || !in_file(s.sh_offset + (r.begin - s.sh_addr), r.end - r.begin))
+                return {};
+            std::string bytes(m_image + s.sh_offset + (r.begin - s.sh_addr), r.end - r.begin);
+            auto it = std::lower_bound(m_relocs.begin(), m_relocs.end(), r.begin,
+                                       [](const reloc &rel, std::uint64_t v) { return rel.offset < v; });
+            for (; it != m_relocs.end() && it->offset < r.end; ++it)
+            {
+                std::size_t at = it->offset - r.begin;
+                bytes.replace(at, std::min(field_size(it->type), bytes.size() - at),
+                              std::min(field_size(it->type), bytes.size() - at), '\0');
+            }
+            return bytes;
+        }
+
+        std::uint64_t content(const region &r)
+        {
+            auto [it, inserted] = m_contents.try_emplace(r.begin, 0);
+            if (inserted)
+            {
+                std::string bytes = zeroed(r);
+                std::uint64_t size = r.end - r.begin;
+                it->second = fnv1a(bytes.data(), bytes.size(), fnv1a(&size, sizeof(size)));
+            }
+            return it->second;
+        }
+
+        const local_hash &local(const region &r)
+        {
+            auto found = m_locals.find(r.begin);
+            if (found != m_locals.end())
+                return found->second;
+            local_hash h{content(r), {}};
+            auto it = std::lower_bound(m_relocs.begin(), m_relocs.end(), r.begin,
+                                       [](const reloc &rel, std::uint64_t v) { return rel.offset < v; });
+            for (; it != m_relocs.end() && it->offset < r.end; ++it)
+            {
+                const ElfW(Sym) &sym = m_syms[it->sym];
+                std::int64_t addend = it->addend + pc_bias(it->type);
+                std::uint64_t mix[4] = {it->offset - r.begin, it->type, 0, 0};
+                if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= m_ehdr->e_shnum ||
+                    ELF64_ST_TYPE(sym.st_info) == STT_TLS)
+                {
+                    const char *name = m_strtab + sym.st_name;
+                    mix[2] = fnv1a(name, std::strlen(name));
+                    mix[3] = static_cast<std::uint64_t>(addend);
+                }
+                else
+                {
+                    std::uint64_t target = sym.st_value;
+                    if (ELF64_ST_TYPE(sym.st_info) == STT_SECTION)
+                        target += static_cast<std::uint64_t>(addend);
+                    region t = find_region(target);
+                    mix[2] = content(t);
+                    mix[3] = ELF64_ST_TYPE(sym.st_info) == STT_SECTION
+                                 ? target - t.begin
+                                 : target - t.begin + static_cast<std::uint64_t>(addend);
+                    h.targets.push_back(t);
+                }
+                h.hash = fnv1a(mix, sizeof(mix), h.hash);
+            }
+            return m_locals.emplace(r.begin, std::move(h)).first->second;
+        }
+
+        const char *m_image;
+        std::size_t m_size;
+        const ElfW(Ehdr) *m_ehdr;
+        const ElfW(Shdr) *m_shdrs;
+        std::size_t m_symtab_index = 0;
+        const ElfW(Sym) *m_syms = nullptr;
+        std::size_t m_sym_count = 0;
+        const char *m_strtab = nullptr;
+        std::vector<symbol> m_symbols;
+        std::vector<reloc> m_relocs;
+        std::vector<std::uint64_t> m_targets;
+        std::unordered_map<std::uint64_t, std::uint64_t> m_contents;
+        std::unordered_map<std::uint64_t, local_hash> m_locals;
+    };
+#endif
+
+    /**
+     * @brief
+     *  Hashes the code of every registered test, keyed by its function.
+     *  In an executable linked with `--emit-relocs`, a test hashes its
+     *  function and everything it reaches through relocations: the code it
+     *  calls, the strings and objects it uses, and what those refer to in
+     *  turn (see `elf_code_hasher`). Editing one test, or code only it
+     *  uses, changes only its own hash.
+     *
+     *  Without relocations, each test hashes the bytes of its function mixed
+     *  with the rest of the executable code. `ASSERTIFY_TEST` puts test
+     *  functions in a section of their own, so editing one test only shifts
+     *  the tests placed after it when its size changes, while any change to
+     *  shared code changes every hash. Data is left out, since assertion
+     *  messages and line numbers live there.
+     *
+     *  Empty if the executable cannot be read; without a symbol table every
+     *  test gets the hash of the whole program code.
+     */
+    inline std::unordered_map<std::uintptr_t, std::uint64_t> hash_test_code()
+    {
+        std::unordered_map<std::uintptr_t, std::uint64_t> hashes;
+#if defined(__linux__) && defined(ASSERTIFY_HAS_EHDR_START)
+        int fd = ::open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return hashes;
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return hashes;
+        const char *image = static_cast<const char *>(map);
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+
+        const auto *ehdr = reinterpret_cast<const ElfW(Ehdr) *>(image);
+        if (size >= sizeof(ElfW(Ehdr)) && std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0 &&
+            ehdr->e_shoff + ehdr->e_shnum * sizeof(ElfW(Shdr)) <= size && ehdr->e_shstrndx < ehdr->e_shnum)
+        {
+            const auto *shdrs = reinterpret_cast<const ElfW(Shdr) *>(image + ehdr->e_shoff);
+            std::uintptr_t base = main_module().base;
+            elf_code_hasher hasher(image, size);
+            if (hasher.has_relocations())
+            {
+                for (const test_case *test : registered_tests())
+                {
+                    auto fn = reinterpret_cast<std::uintptr_t>(test->fn);
+                    hashes[fn] = hasher.reachable(fn - base);
+                }
+                ::munmap(map, size);
+                return hashes;
+            }
+
+            // File ranges of the test functions, keyed by their address at run time
+            struct range
+            {
+                std::size_t begin, end;
+                std::uintptr_t fn;
+            };
+            std::unordered_map<std::uintptr_t, std::uintptr_t> by_vaddr;
+            for (const test_case *test : registered_tests())
+            {
+                auto fn = reinterpret_cast<std::uintptr_t>(test->fn);
+                by_vaddr[fn - base] = fn;
+            }
+            std::vector<range> ranges;
+            for (std::size_t i = 0; i < ehdr->e_shnum; ++i)
+            {
+                if (shdrs[i].sh_type != SHT_SYMTAB || shdrs[i].sh_entsize != sizeof(ElfW(Sym)))
+                    continue;
+                const auto *syms = reinterpret_cast<const ElfW(Sym) *>(image + shdrs[i].sh_offset);
+                for (std::size_t n = 0; n < shdrs[i].sh_size / sizeof(ElfW(Sym)); ++n)
+                {
+                    const ElfW(Sym) &sym = syms[n];
+                    if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_shndx == SHN_UNDEF ||
+                        sym.st_shndx >= ehdr->e_shnum)
+                        continue;
+                    auto it = by_vaddr.find(sym.st_value);
+                    if (it == by_vaddr.end())
+                        continue;
+                    const ElfW(Shdr) &section = shdrs[sym.st_shndx];
+                    std::size_t begin = sym.st_value - section.sh_addr + section.sh_offset;
+                    ranges.push_back({begin, begin + sym.st_size, it->second});
+                    by_vaddr.erase(it);
+                }
+            }
+            if (!by_vaddr.empty())
+                ranges.clear();
+            std::sort(ranges.begin(), ranges.end(),
+                      [](const range &a, const range &b) { return a.begin < b.begin; });
+
+            std::uint64_t shared = fnv1a(nullptr, 0);
+            for (std::size_t i = 0; i < ehdr->e_shnum; ++i)
+            {
+                const ElfW(Shdr) &section = shdrs[i];
+                if (section.sh_type != SHT_PROGBITS || !(section.sh_flags & SHF_ALLOC) ||
+                    !(section.sh_flags & SHF_EXECINSTR) || section.sh_offset + section.sh_size > size)
+                    continue;
+                std::size_t pos = section.sh_offset, end = section.sh_offset + section.sh_size;
+                for (const range &r : ranges)
+                {
+                    if (r.end <= pos || r.begin >= end)
+                        continue;
+                    shared = fnv1a(image + pos, r.begin - pos, shared);
+                    pos = std::max(pos, r.end);
+                }
+                if (pos < end)
+                    shared = fnv1a(image + pos, end - pos, shared);
+            }
+            for (const test_case *test : registered_tests())
+                hashes[reinterpret_cast<std::uintptr_t>(test->fn)] = shared;
+            for (const range &r : ranges)
+                hashes[r.fn] = fnv1a(image + r.begin, r.end - r.begin, shared);
+        }
+        ::munmap(map, size);
+#endif
+        return hashes;
+    }
+
+    /** Hash of the code of `test` in this executable, 0 if unknown. */
+    inline std::uint64_t code_hash(const test_case &test)
+    {
+        static const std::unordered_map<std::uintptr_t, std::uint64_t> hashes = hash_test_code();
+        auto it = hashes.find(reinterpret_cast<std::uintptr_t>(test.fn));
+        return it == hashes.end() || it->second == 0 ? 0 : it->second;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Results of past runs kept in a memory-mapped file: per test the status,
+ *  duration and code hash of its last run. The file is an open addressing
+ *  table updated in place as each test finishes, so a run that is killed
+ *  halfway keeps the results it got, and the shards of one binary can
+ *  share a file.
+ */
+class test_cache
+{
+public:
+    /** Maps `path`, creating it, or rebuilding it if it has no room for `tests` tests. */
+    test_cache(const std::string &path, std::size_t tests)
+    {
+        std::uint32_t capacity = 64;
+        while (capacity < 2 * tests)
+            capacity *= 2;
+        if (map(path, 0) && m_header->capacity >= capacity)
+            return;
+
+        // Carry the entries over into a new file and replace the old one with it
+        test_cache_header *old = m_header;
+        std::size_t old_size = m_size;
+        std::string tmp = path + "." + std::to_string(::getpid());
+        if (map(tmp, capacity))
+        {
+            for (std::uint32_t i = 0; old != nullptr && i < old->capacity; ++i)
+            {
+                const test_cache_entry &from = entries(old)[i];
+                test_cache_entry *to = probe(from.name_hash.load(), true);
+                if (to == nullptr)
+                    continue;
+                to->code_hash = from.code_hash;
+                to->duration_ns = from.duration_ns;
+                to->status = from.status;
+                to->runs = from.runs;
+                std::memcpy(to->name, from.name, sizeof(to->name));
+            }
+            if (::rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                ::unlink(tmp.c_str());
+                unmap();
+            }
+        }
+        if (old != nullptr)
+            ::munmap(old, old_size);
+    }
+
+    ~test_cache() { unmap(); }
+
+    test_cache(const test_cache &) = delete;
+    test_cache &operator=(const test_cache &) = delete;
+
+    bool is_open() const { return m_header != nullptr; }
+
+    /** Entry of the test `name`, or `nullptr` if it has none. */
+    test_cache_entry *find(const char *name) const { return probe(detail::name_hash(name), false); }
+
+    /** Entry of the test `name`, created if needed; `nullptr` if the cache is not open. */
+    test_cache_entry *insert(const char *name)
+    {
+        test_cache_entry *entry = probe(detail::name_hash(name), true);
+        if (entry != nullptr && entry->name[0] == '\0')
+            std::strncpy(entry->name, name, sizeof(entry->name) - 1);
+        return entry;
+    }
+
+private:
+    static test_cache_entry *entries(test_cache_header *header)
+    {
+        return reinterpret_cast<test_cache_entry *>(header + 1);
+    }
+
+    /** Maps an existing cache file, or creates one with `capacity` entries if it is not 0. */
+    bool map(const std::string &path, std::uint32_t capacity)
+    {
+        m_header = nullptr;
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | (capacity ? O_TRUNC : 0), 0644);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        std::size_t size = sizeof(test_cache_header) + std::size_t(capacity) * sizeof(test_cache_entry);
+        bool ok = capacity != 0 ? ::ftruncate(fd, static_cast<off_t>(size)) == 0
+                                : ::fstat(fd, &st) == 0 && (size = static_cast<std::size_t>(st.st_size)) >=
+                                                               sizeof(test_cache_header);
+        void *map = ok ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (map == MAP_FAILED)
+            return false;
+
+        auto *header = static_cast<test_cache_header *>(map);
+        if (capacity != 0)
+        {
+            header->version = test_cache_version;
+            header->entry_size = sizeof(test_cache_entry);
+            header->capacity = capacity;
+            std::memcpy(header->magic, test_cache_magic, sizeof(header->magic));
+        }
+        else if (std::memcmp(header->magic, test_cache_magic, sizeof(header->magic)) != 0 ||
+                 header->version != test_cache_version ||
+                 header->entry_size != sizeof(test_cache_entry) || header->capacity == 0 ||
+                 (header->capacity & (header->capacity - 1)) != 0 ||
+                 size != sizeof(test_cache_header) + std::size_t(header->capacity) * sizeof(test_cache_entry))
+        {
+            ::munmap(map, size);
+            return false;
+        }
+        m_header = header;
+        m_size = size;
+        return true;
+    }
+
+    void unmap()
+    {
+        if (m_header != nullptr)
+            ::munmap(m_header, m_size);
+        m_header = nullptr;
+    }
+
+    test_cache_entry *probe(std::uint64_t hash, bool insert) const
+    {
+        if (m_header == nullptr || hash == 0)
+            return nullptr;
+        std::uint32_t mask = m_header->capacity - 1;
+        for (std::uint32_t i = 0; i <= mask; ++i)
+        {
+            test_cache_entry &entry = entries(m_header)[(hash + i) & mask];
+            std::uint64_t current = entry.name_hash.load(std::memory_order_acquire);
+            // Another process sharing the file may claim the slot at the same time
+            if (current == 0 && insert && entry.name_hash.compare_exchange_strong(current, hash))
+                return &entry;
+            if (current == hash)
+                return &entry;
+            if (current == 0)
+                return nullptr;
+        }
+        return nullptr;
+    }
+
+    test_cache_header *m_header = nullptr;
+    std::size_t m_size = 0;
+};
+
+namespace detail
+{
+    /** Matches `text` against a glob with `*` and `?`. */
+    inline bool glob_match(const char *pattern, const char *text)
+    {
+        const char *star = nullptr, *resume = nullptr;
+        while (*text != '\0')
+        {
+            if (*pattern == '*')
+            {
+                star = pattern++;
+                resume = text;
+            }
+            else if (*pattern != '\0' && (*pattern == '?' || *pattern == *text))
+            {
+                ++pattern;
+                ++text;
+            }
+            else if (star != nullptr)
+            {
+                pattern = star + 1;
+                text = ++resume;
+            }
+            else
+                return false;
+        }
+        while (*pattern == '*')
+            ++pattern;
+        return *pattern == '\0';
+    }
+
+    inline bool filter_match(const std::string &filter, const char *name)
+    {
+        bool any_included = false, included = false;
+        for (std::size_t begin = 0; begin < filter.size();)
+        {
+            std::size_t end = std::min(filter.find(':', begin), filter.size());
+            std::string pattern = filter.substr(begin, end - begin);
+            begin = end + 1;
+            if (pattern.empty())
+                continue;
+            if (pattern[0] == '-')
+            {
+                if (glob_match(pattern.c_str() + 1, name))
+                    return false;
+                continue;
+            }
+            any_included = true;
+            included = included || glob_match(pattern.c_str(), name);
+        }
+        return !any_included || included;
+    }
+
+    inline std::uint64_t since(std::chrono::steady_clock::time_point start)
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                              std::chrono::steady_clock::now() - start)
+                                              .count());
+    }
+
+    /** Runs `test` on the calling thread and returns why it failed, or "". */
+    inline std::string run_test_here(const test_case &test)
+    {
+        t_test_failures = 0;
+        try
+        {
+            test.fn();
+        }
+        catch (const ::AssertionError &e)
+        {
+            return std::string("Assertion failed: ") + e.what() + " (" + e.file() +
+                   ", Line: " + std::to_string(e.line()) + ")";
+        }
+        catch (const std::exception &e)
+        {
+            return std::string("threw: ") + e.what();
+        }
+        catch (...)
+        {
+            return "threw an unknown exception";
+        }
+        if (t_test_failures != 0)
+            return std::to_string(t_test_failures) + " failed check(s)";
+        return {};
+    }
+
+    /** Fails a test that finished but went over a resource budget of `opts`. */
+    inline void check_budgets(test_result &r, const test_options &opts)
+    {
+        char reason[96];
+        if (!r.passed)
+            return;
+        if (opts.max_rss_kb != 0 && r.peak_rss_kb > opts.max_rss_kb)
+            std::snprintf(reason, sizeof(reason), "peak RSS %.1f MB over the budget of %.1f MB",
+                          static_cast<double>(r.peak_rss_kb) / 1024,
+                          static_cast<double>(opts.max_rss_kb) / 1024);
+        else if (opts.max_allocations != 0 && counts_allocations() &&
+                 r.allocations > opts.max_allocations)
+            std::snprintf(reason, sizeof(reason), "%llu allocations over the budget of %llu",
+                          static_cast<unsigned long long>(r.allocations),
+                          static_cast<unsigned long long>(opts.max_allocations));
+        else
+            return;
+        r.passed = false;
+        r.reason = reason;
+    }
+
+    inline std::string timeout_reason(const test_options &opts)
+    {
+        return "timed out after " + std::to_string(opts.timeout_ms) + " ms";
+    }
+
+    /** Appends `text` as the body of a JSON (or YAML double-quoted) string. */
+    inline void append_json(std::string &out, std::string_view text)
+    {
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                    out += escaped;
+                }
+                else
+                    out += c;
+            }
+        }
+    }
+
+    /** Appends `text` escaped for XML, dropping the control characters XML 1.0 forbids. */
+    inline void append_xml(std::string &out, std::string_view text)
+    {
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '&':
+                out += "&amp;";
+                break;
+            case '<':
+                out += "&lt;";
+                break;
+            case '>':
+                out += "&gt;";
+                break;
+            case '"':
+                out += "&quot;";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) >= 0x20 || c == '\n' || c == '\t' || c == '\r')
+                    out += c;
+            }
+        }
+    }
+
+    /** "Usage:" line of a failed test: duration, peak RSS and allocations. */
+    inline std::string describe_usage(const test_result &r)
+    {
+        char line[128];
+        int n = std::snprintf(line, sizeof(line), "%.1f ms", static_cast<double>(r.duration_ns) / 1e6);
+        if (r.peak_rss_kb != 0)
+            n += std::snprintf(line + n, sizeof(line) - n, ", peak RSS %.1f MB",
+                               static_cast<double>(r.peak_rss_kb) / 1024);
+        if (counts_allocations())
+            std::snprintf(line + n, sizeof(line) - n, ", %llu allocations",
+                          static_cast<unsigned long long>(r.allocations));
+        return line;
+    }
+
+    /** Console report of a finished test. */
+    inline std::string format_console(const test_result &r)
+    {
+        char line[64];
+        std::snprintf(line, sizeof(line), " (%.1f ms)\n", static_cast<double>(r.duration_ns) / 1e6);
+        std::string report = (r.passed ? "PASS\t" : "FAIL\t") + std::string(r.test->name) + line;
+        if (!r.passed)
+        {
+            report += "Reason:\t\t" + r.reason + "\nUsage:\t\t" + describe_usage(r) +
+                      "\nSource:\t\t" + r.test->file + ", Line: " + std::to_string(r.test->line) +
+                      "\nOutput:";
+            append_output(report, r.output);
+        }
+        return report;
+    }
+
+    /** TAP line of the `number`-th finished test, with a YAML block if it failed. */
+    inline std::string format_tap(const test_result &r, std::size_t number)
+    {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%s %zu - ", r.passed ? "ok" : "not ok", number);
+        std::string report = line + std::string(r.test->name);
+        std::snprintf(line, sizeof(line), " # time=%.3fms\n", static_cast<double>(r.duration_ns) / 1e6);
+        report += line;
+        if (r.passed)
+            return report;
+        report += "  ---\n  message: \"";
+        append_json(report, r.reason);
+        report += "\"\n  severity: fail\n  file: \"";
+        append_json(report, r.test->file);
+        report += "\"\n  line: " + std::to_string(r.test->line) + "\n  usage: \"" + describe_usage(r) +
+                  "\"\n  output: \"";
+        append_json(report, r.output);
+        report += "\"\n  ...\n";
+        return report;
+    }
+
+    /** JSON object of a finished test, on one line. */
+    inline std::string format_json(const test_result &r)
+    {
+        std::string report = "{\"name\":\"";
+        append_json(report, r.test->name);
+        report += "\",\"file\":\"";
+        append_json(report, r.test->file);
+        char fields[256];
+        std::snprintf(fields, sizeof(fields),
+                      "\",\"line\":%d,\"status\":\"%s\",\"duration_ms\":%.3f,\"timed_out\":%s,"
+                      "\"peak_rss_kb\":%llu,\"allocations\":",
+                      r.test->line, r.passed ? "passed" : "failed",
+                      static_cast<double>(r.duration_ns) / 1e6, r.timed_out ? "true" : "false",
+                      static_cast<unsigned long long>(r.peak_rss_kb));
+        report += fields;
+        report += counts_allocations() ? std::to_string(r.allocations) : "null";
+        report += ",\"reason\":\"";
+        append_json(report, r.reason);
+        report += "\",\"output\":\"";
+        append_json(report, r.output);
+        report += "\"}\n";
+        return report;
+    }
+
+    /** JUnit XML document with one test suite named `suite`. */
+    inline std::string format_junit(const std::vector<test_result> &results, const std::string &suite,
+                                    std::uint64_t elapsed_ns, std::time_t started)
+    {
+        std::size_t failures = 0;
+        for (const test_result &r : results)
+            failures += r.passed ? 0 : 1;
+        char timestamp[32], totals[192];
+        std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", std::gmtime(&started));
+        std::snprintf(totals, sizeof(totals),
+                      "\" tests=\"%zu\" failures=\"%zu\" errors=\"0\" skipped=\"0\" time=\"%.6f\" "
+                      "timestamp=\"%s\">\n",
+                      results.size(), failures, static_cast<double>(elapsed_ns) / 1e9, timestamp);
+        std::string xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites name=\"";
+        append_xml(xml, suite);
+        xml += totals;
+        xml += "  <testsuite name=\"";
+        append_xml(xml, suite);
+        xml += totals;
+        for (const test_result &r : results)
+        {
+            xml += "    <testcase name=\"";
+            append_xml(xml, r.test->name);
+            xml += "\" classname=\"";
+            append_xml(xml, suite);
+            xml += "\" file=\"";
+            append_xml(xml, r.test->file);
+            std::snprintf(totals, sizeof(totals), "\" line=\"%d\" time=\"%.6f\"", r.test->line,
+                          static_cast<double>(r.duration_ns) / 1e9);
+            xml += totals;
+            if (r.passed && r.output.empty())
+            {
+                xml += "/>\n";
+                continue;
+            }
+            xml += ">\n";
+            if (!r.passed)
+            {
+                xml += "      <failure message=\"";
+                append_xml(xml, r.reason);
+                xml += r.timed_out ? "\" type=\"timeout\">" : "\" type=\"failure\">";
+                append_xml(xml, "Usage: " + describe_usage(r));
+                xml += "</failure>\n";
+            }
+            if (!r.output.empty())
+            {
+                xml += "      <system-out>";
+                append_xml(xml, r.output);
+                xml += "</system-out>\n";
+            }
+            xml += "    </testcase>\n";
+        }
+        xml += "  </testsuite>\n</testsuites>\n";
+        return xml;
+    }
+
+    /**
+     * @brief
+     *  The one consumer of finished tests. Workers hand a result over with
+     *  one allocation and one atomic exchange on an intrusive MPSC queue
+     *  (Vyukov's), so reporting never blocks a test thread on I/O or on a
+     *  lock. The writer thread records each result in the cache, prints it
+     *  and streams it as TAP and JSON lines; the JUnit XML, whose header
+     *  carries the totals, is written from the same records on `close`.
+     */
+    class result_writer
+    {
+    public:
+        result_writer(const test_options &opts, std::size_t planned, test_cache *cache)
+            : m_head(&m_stub), m_tail(&m_stub), m_cache(cache), m_suite(opts.suite_name),
+              m_junit_path(opts.junit_path), m_start(std::chrono::steady_clock::now()),
+              m_started(std::time(nullptr))
+        {
+            m_tap = open_output(opts.tap_path);
+            m_jsonl = open_output(opts.jsonl_path);
+            if (m_tap >= 0)
+            {
+                std::string header = "TAP version 14\n1.." + std::to_string(planned) + "\n";
+                write_report(header.data(), header.size(), m_tap);
+            }
+            m_thread = std::thread([this] { run(); });
+        }
+
+        result_writer(const result_writer &) = delete;
+        result_writer &operator=(const result_writer &) = delete;
+
+        ~result_writer() { close(); }
+
+        /** Queues a finished test; safe from any number of threads. */
+        void publish(const test_result &r)
+        {
+            node *n = new node{{nullptr}, r};
+            node *prev = m_head.exchange(n, std::memory_order_acq_rel);
+            prev->next.store(n, std::memory_order_release);
+            m_published.fetch_add(1, std::memory_order_release);
+            signal();
+        }
+
+        /** Writes everything published so far, then the JUnit XML, and stops the writer thread. */
+        void close()
+        {
+            if (!m_thread.joinable())
+                return;
+            m_closing.store(true, std::memory_order_release);
+            signal();
+            m_thread.join();
+            if (!m_junit_path.empty())
+            {
+                std::string xml = format_junit(m_written, m_suite, since(m_start), m_started);
+                int fd = open_output(m_junit_path);
+                if (fd >= 0)
+                {
+                    write_report(xml.data(), xml.size(), fd);
+                    ::close(fd);
+                }
+            }
+            for (int fd : {m_tap, m_jsonl})
+            {
+                if (fd >= 0)
+                    ::close(fd);
+            }
+        }
+
+    private:
+        struct node
+        {
+            std::atomic<node *> next;
+            test_result result;
+        };
+
+        static int open_output(const std::string &path)
+        {
+            if (path.empty())
+                return -1;
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                std::string error = "Cannot write " + path + ": " + std::strerror(errno) + "\n";
+                write_report(error.data(), error.size());
+            }
+            return fd;
+        }
+
+        void signal()
+        {
+            m_signals.fetch_add(1, std::memory_order_release);
+#if defined(__cpp_lib_atomic_wait)
+            m_signals.notify_one();
+#endif
+        }
+
+        /**
+         * Takes the oldest node off the queue, or returns null if it is empty
+         * or its next node is still being linked in by a producer.
+         */
+        node *pop()
+        {
+            node *tail = m_tail;
+            node *next = tail->next.load(std::memory_order_acquire);
+            if (tail == &m_stub)
+            {
+                if (next == nullptr)
+                    return nullptr;
+                m_tail = tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next != nullptr)
+            {
+                m_tail = next;
+                return tail;
+            }
+            if (tail != m_head.load(std::memory_order_acquire))
+                return nullptr;
+            // `tail` is the last node: put the stub behind it so it can be taken
+            m_stub.next.store(nullptr, std::memory_order_relaxed);
+            node *prev = m_head.exchange(&m_stub, std::memory_order_acq_rel);
+            prev->next.store(&m_stub, std::memory_order_release);
+            next = tail->next.load(std::memory_order_acquire);
+            if (next == nullptr)
+                return nullptr;
+            m_tail = next;
+            return tail;
+        }
+
+        void write(const test_result &r)
+        {
+            if (test_cache_entry *entry = m_cache != nullptr ? m_cache->find(r.test->name) : nullptr)
+            {
+                entry->code_hash = code_hash(*r.test);
+                entry->duration_ns = r.duration_ns;
+                entry->status = r.passed ? test_status::passed : test_status::failed;
+                ++entry->runs;
+            }
+            std::string report = format_console(r);
+            write_report(report.data(), report.size());
+            if (m_tap >= 0)
+            {
+                report = format_tap(r, m_written.size() + 1);
+                write_report(report.data(), report.size(), m_tap);
+            }
+            if (m_jsonl >= 0)
+            {
+                report = format_json(r);
+                write_report(report.data(), report.size(), m_jsonl);
+            }
+            m_written.push_back(r);
+        }
+
+        void run()
+        {
+            std::uint64_t consumed = 0;
+            for (;;)
+            {
+                std::uint64_t signals = m_signals.load(std::memory_order_acquire);
+                while (node *n = pop())
+                {
+                    write(n->result);
+                    delete n;
+                    ++consumed;
+                }
+                std::uint64_t published = m_published.load(std::memory_order_acquire);
+                if (consumed != published)
+                {
+                    // A producer is between its exchange and its link
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (m_closing.load(std::memory_order_acquire))
+                    break;
+#if defined(__cpp_lib_atomic_wait)
+                m_signals.wait(signals, std::memory_order_acquire);
+#else
+                (void)signals;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+            }
+        }
+
+        node m_stub{{nullptr}, {}};
+        std::atomic<node *> m_head;
+        node *m_tail;
+        std::atomic<std::uint64_t> m_published{0};
+        std::atomic<std::uint64_t> m_signals{0};
+        std::atomic<bool> m_closing{false};
+        test_cache *m_cache;
+        std::string m_suite;
+        std::string m_junit_path;
+        int m_tap = -1;
+        int m_jsonl = -1;
+        std::chrono::steady_clock::time_point m_start;
+        std::time_t m_started;
+        /** Results in the order they finished, for the JUnit XML. */
+        std::vector<test_result> m_written;
+        std::thread m_thread;
+    };
+
+    /**
+     * Runs the tests on `jobs` threads. Each thread starts with its own deque
+     * of tests, dealt round-robin in run order, takes from its front and
+     * steals from the back of the others once it is empty.
+     *
+     * The calling thread is the watchdog. A thread cannot be stopped, so a
+     * test that runs past the timeout is reported as timed out and its
+     * worker is abandoned: it is detached and drops its result if the test
+     * ever returns, and a new thread takes its place and its queue, so the
+     * remaining tests still run. The state shared with the workers is
+     * reference counted for that reason.
+     */
+    inline std::vector<test_result> run_in_threads(const std::vector<const test_case *> &tests,
+                                                   std::size_t jobs, const test_options &opts,
+                                                   result_writer &writer)
+    {
+        constexpr std::size_t idle = SIZE_MAX;
+        struct work_queue
+        {
+            std::mutex mutex;
+            std::deque<std::size_t> tests;
+        };
+        struct worker
+        {
+            /** Index of the running test, or `idle`; whoever swaps it out owns the result. */
+            std::atomic<std::size_t> test{idle};
+            std::atomic<std::int64_t> start_ns{0};
+            std::atomic<bool> finished{false};
+        };
+        struct pool
+        {
+            explicit pool(std::size_t jobs, std::size_t tests) : queues(jobs), results(tests)
+            {
+                for (std::size_t w = 0; w < jobs; ++w)
+                    workers.push_back(std::make_unique<worker>());
+            }
+            std::vector<work_queue> queues;
+            /** Only the watchdog replaces a slot, and only after its thread was abandoned. */
+            std::vector<std::unique_ptr<worker>> workers;
+            /** Workers of abandoned threads, which may still return to them. */
+            std::vector<std::unique_ptr<worker>> abandoned;
+            std::vector<test_result> results;
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<pool>(jobs, tests.size());
+        for (std::size_t i = 0; i < tests.size(); ++i)
+            state->queues[i % jobs].tests.push_back(i);
+
+        auto now_ns = [] {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        };
+        auto work = [state, &tests, &opts, &writer, now_ns](std::size_t self) {
+            worker &me = *state->workers[self];
+            for (;;)
+            {
+                std::size_t i = idle;
+                for (std::size_t k = 0; k < state->queues.size() && i == idle; ++k)
+                {
+                    work_queue &q = state->queues[(self + k) % state->queues.size()];
+                    std::lock_guard<std::mutex> lock(q.mutex);
+                    if (q.tests.empty())
+                        continue;
+                    i = k == 0 ? q.tests.front() : q.tests.back();
+                    k == 0 ? q.tests.pop_front() : q.tests.pop_back();
+                }
+                if (i == idle)
+                    break;
+
+                const test_case *test = tests[i];
+                std::int64_t start = now_ns();
+                me.start_ns.store(start, std::memory_order_relaxed);
+                me.test.store(i, std::memory_order_release);
+                std::uint64_t allocations = t_allocations;
+                std::string reason = run_test_here(*test);
+                allocations = t_allocations - allocations;
+                if (me.test.exchange(idle, std::memory_order_acq_rel) != i)
+                    return; // Abandoned by the watchdog; only `state` is still alive
+
+                test_result &r = state->results[i];
+                r = {test, reason.empty(), static_cast<std::uint64_t>(now_ns() - start),
+                     std::move(reason), {}, false, 0, allocations};
+                check_budgets(r, opts);
+                writer.publish(r);
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            me.finished.store(true);
+            state->finished.notify_all();
+        };
+
+        std::vector<std::thread> threads;
+        for (std::size_t w = 0; w < jobs; ++w)
+            threads.emplace_back(work, w);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        for (;;)
+        {
+            bool running = false;
+            for (std::size_t w = 0; w < jobs; ++w)
+            {
+                worker &wk = *state->workers[w];
+                if (wk.finished.load())
+                    continue;
+                running = true;
+                std::size_t i = wk.test.load(std::memory_order_acquire);
+                std::int64_t elapsed = now_ns() - wk.start_ns.load(std::memory_order_relaxed);
+                if (opts.timeout_ms == 0 || i == idle ||
+                    elapsed < static_cast<std::int64_t>(opts.timeout_ms * 1000000) ||
+                    !wk.test.compare_exchange_strong(i, idle))
+                    continue;
+                state->results[i] = {tests[i], false, static_cast<std::uint64_t>(elapsed),
+                                     timeout_reason(opts), {}, true, 0, 0};
+                writer.publish(state->results[i]);
+                threads[w].detach();
+                state->abandoned.push_back(std::move(state->workers[w]));
+                state->workers[w] = std::make_unique<worker>();
+                threads[w] = std::thread(work, w);
+            }
+            if (!running)
+                break;
+            state->finished.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        lock.unlock();
+        for (std::thread &thread : threads)
+            thread.join();
+        return state->results;
+    }
+
+    /** `ru_maxrss` in KiB; macOS reports it in bytes. */
+    inline std::uint64_t max_rss_kb(const struct rusage &usage)
+    {
+#if defined(__APPLE__)
+        return static_cast<std::uint64_t>(usage.ru_maxrss) / 1024;
+#else
+        return static_cast<std::uint64_t>(usage.ru_maxrss);
+#endif
+    }
+
+    /**
+     * Runs each test in a forked child, at most `jobs` at a time and started
+     * in run order. A crash or a failed assertion ends only its own test; the
+     * child's stdout and stderr are kept for the report.
+     *
+     * The poll loop doubles as the watchdog: it wakes at the earliest
+     * deadline and kills the process group of a test that runs past the
+     * timeout, so death test children it started go with it. Peak RSS comes
+     * from `wait4`, less the resident set the child inherited at fork, which
+     * it records on a shared page right after the fork along with its
+     * allocation count before it exits.
+     */
+    inline std::vector<test_result> run_in_processes(const std::vector<const test_case *> &tests,
+                                                     std::size_t jobs, const test_options &opts,
+                                                     result_writer &writer)
+    {
+        struct child
+        {
+            pid_t pid;
+            int fd;
+            std::size_t index;
+            std::chrono::steady_clock::time_point start;
+            bool timed_out;
+        };
+        struct child_counts
+        {
+            std::uint64_t allocations;
+            std::uint64_t inherited_rss_kb;
+        };
+        std::size_t counts_size = std::max<std::size_t>(1, tests.size()) * sizeof(child_counts);
+        void *counts_map = ::mmap(nullptr, counts_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        auto *counts = counts_map == MAP_FAILED ? nullptr : static_cast<child_counts *>(counts_map);
+        auto timeout = std::chrono::milliseconds(opts.timeout_ms);
+
+        std::vector<test_result> results(tests.size());
+        std::vector<child> running;
+        std::size_t next = 0;
+        while (next < tests.size() || !running.empty())
+        {
+            for (; next < tests.size() && running.size() < jobs; ++next)
+            {
+                results[next] = {tests[next], false, 0, {}, {}, false, 0, 0};
+                int fds[2];
+                if (::pipe(fds) != 0)
+                {
+                    results[next].reason = std::string("pipe failed: ") + std::strerror(errno);
+                    writer.publish(results[next]);
+                    continue;
+                }
+                ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+                std::fflush(nullptr);
+                std::cout.flush();
+                auto start = std::chrono::steady_clock::now();
+                pid_t pid = ::fork();
+                if (pid == 0)
+                {
+                    ::setpgid(0, 0);
+                    struct rusage inherited = {};
+                    if (counts != nullptr && ::getrusage(RUSAGE_SELF, &inherited) == 0)
+                        counts[next].inherited_rss_kb = max_rss_kb(inherited);
+                    ::dup2(fds[1], 1);
+                    ::dup2(fds[1], 2);
+                    ::close(fds[0]);
+                    ::close(fds[1]);
+                    std::uint64_t allocations = g_allocations.load();
+                    std::string reason = run_test_here(*tests[next]);
+                    if (counts != nullptr)
+                        counts[next].allocations = g_allocations.load() - allocations;
+                    if (!reason.empty())
+                        std::fprintf(stderr, "%s\n", reason.c_str());
+                    std::fflush(nullptr);
+                    std::cout.flush();
+                    ::_exit(reason.empty() ? 0 : 1);
+                }
+                ::close(fds[1]);
+                if (pid < 0)
+                {
+                    ::close(fds[0]);
+                    results[next].reason = std::string("fork failed: ") + std::strerror(errno);
+                    writer.publish(results[next]);
+                    continue;
+                }
+                // Also set here, so the group exists before the child gets to it
+                ::setpgid(pid, pid);
+                running.push_back({pid, fds[0], next, start, false});
+            }
+            if (running.empty())
+                continue;
+
+            int wait_ms = -1;
+            auto now = std::chrono::steady_clock::now();
+            for (const child &c : running)
+            {
+                if (opts.timeout_ms == 0 || c.timed_out)
+                    continue;
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(c.start + timeout - now);
+                int ms = static_cast<int>(std::max<std::int64_t>(0, left.count()));
+                wait_ms = wait_ms < 0 ? ms : std::min(wait_ms, ms);
+            }
+            std::vector<pollfd> fds;
+            for (const child &c : running)
+                fds.push_back({c.fd, POLLIN, 0});
+            if (::poll(fds.data(), fds.size(), wait_ms) < 0 && errno != EINTR)
+                break;
+
+            now = std::chrono::steady_clock::now();
+            for (child &c : running)
+            {
+                if (opts.timeout_ms == 0 || c.timed_out || now < c.start + timeout)
+                    continue;
+                ::kill(-c.pid, SIGKILL);
+                c.timed_out = true;
+            }
+            for (std::size_t i = fds.size(); i-- > 0;)
+            {
+                if (fds[i].revents == 0)
+                    continue;
+                child &c = running[i];
+                test_result &r = results[c.index];
+                char buf[4096];
+                ssize_t n = ::read(c.fd, buf, sizeof(buf));
+                if (n > 0 || (n < 0 && errno == EINTR))
+                {
+                    r.output.append(buf, static_cast<std::size_t>(std::max<ssize_t>(n, 0)));
+                    continue;
+                }
+                ::close(c.fd);
+                int status = 0;
+                struct rusage usage = {};
+                while (::wait4(c.pid, &status, 0, &usage) < 0 && errno == EINTR)
+                {
+                }
+                r.duration_ns = since(c.start);
+                r.timed_out = c.timed_out;
+                r.peak_rss_kb = max_rss_kb(usage);
+                if (counts != nullptr)
+                {
+                    r.peak_rss_kb -= std::min(r.peak_rss_kb, counts[c.index].inherited_rss_kb);
+                    r.allocations = counts[c.index].allocations;
+                }
+                r.passed = !c.timed_out && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+                if (c.timed_out)
+                    r.reason = timeout_reason(opts);
+                else if (!r.passed)
+                    r.reason = describe_status(status);
+                check_budgets(r, opts);
+                writer.publish(r);
+                running.erase(running.begin() + static_cast<std::ptrdiff_t>(i));
+            }
+        }
+        if (counts != nullptr)
+            ::munmap(counts_map, counts_size);
+        return results;
+    }
+} // namespace detail
+
+/**
+ * @brief
+ *  Selects the registered tests `opts` asks for, in run order: filtered,
+ *  then every `shard_count`-th of them from `shard_index` on, then longest
+ *  first by the durations in the result cache, with `failed_first` the
+ *  tests that failed last time before all others. Tests without a recorded
+ *  duration run first, since nothing says they are short. With
+ *  `only_changed`, tests that passed last time with the same code hash are
+ *  left out and counted in `unchanged`.
+ */
+inline std::vector<const test_case *> plan_tests(const test_options &opts,
+                                                 std::size_t *unchanged = nullptr)
+{
+    std::vector<const test_case *> all = registered_tests(), selected;
+    for (const test_case *test : all)
+    {
+        if (detail::filter_match(opts.filter, test->name))
+            selected.push_back(test);
+    }
+    std::vector<const test_case *> shard;
+    for (std::size_t i = opts.shard_index; i < selected.size(); i += opts.shard_count)
+        shard.push_back(selected[i]);
+    if (unchanged != nullptr)
+        *unchanged = 0;
+    if (opts.cache_path.empty())
+        return shard;
+
+    test_cache cache(opts.cache_path, all.size());
+    struct past
+    {
+        bool failed;
+        std::uint64_t duration_ns;
+    };
+    std::unordered_map<const test_case *, past> history;
+    std::vector<const test_case *> planned;
+    for (const test_case *test : shard)
+    {
+        const test_cache_entry *entry = cache.find(test->name);
+        if (entry == nullptr || entry->status == test_status::unknown)
+        {
+            history[test] = {false, UINT64_MAX};
+            planned.push_back(test);
+            continue;
+        }
+        std::uint64_t hash = detail::code_hash(*test);
+        if (opts.only_changed && entry->status == test_status::passed && hash != 0 &&
+            entry->code_hash == hash)
+        {
+            if (unchanged != nullptr)
+                ++*unchanged;
+            continue;
+        }
+        history[test] = {entry->status == test_status::failed, entry->duration_ns};
+        planned.push_back(test);
+    }
+    std::stable_sort(planned.begin(), planned.end(), [&](const test_case *a, const test_case *b) {
+        const past &pa = history[a], &pb = history[b];
+        if (opts.failed_first && pa.failed != pb.failed)
+            return pa.failed;
+        return pa.duration_ns > pb.duration_ns;
+    });
+    return planned;
+}
+
+/**
+ * @brief
+ *  Runs `tests` in order on `opts.jobs` workers. Each result is printed and
+ *  streamed to the TAP and JSON lines files as it finishes, and recorded in
+ *  the result cache for the next `plan_tests`; the JUnit XML is written once
+ *  all tests are done.
+ */
+inline std::vector<test_result> run_tests(const std::vector<const test_case *> &tests,
+                                          const test_options &opts)
+{
+    std::optional<test_cache> cache;
+    if (!opts.cache_path.empty())
+    {
+        cache.emplace(opts.cache_path, registered_tests().size());
+        for (const test_case *test : tests)
+            cache->insert(test->name);
+    }
+    test_cache *entries = cache && cache->is_open() ? &*cache : nullptr;
+    std::size_t jobs = std::max<std::size_t>(1, std::min(opts.jobs, tests.size()));
+    detail::result_writer writer(opts, tests.size(), entries);
+    std::vector<test_result> results = opts.threads ? detail::run_in_threads(tests, jobs, opts, writer)
+                                                    : detail::run_in_processes(tests, jobs, opts, writer);
+    writer.close();
+    return results;
+}
+
+/**
+ * @brief
+ *  Parses the runner flags described in `test_options`. The result cache
+ *  defaults to `<argv[0]>.testcache` and the suite name to the base name of
+ *  `argv[0]`.
+ * @return `false` on an unknown flag or a malformed value.
+ */
+inline bool parse_test_options(int argc, char *argv[], test_options &opts)
+{
+    if (argc > 0)
+    {
+        opts.cache_path = std::string(argv[0]) + ".testcache";
+        const char *slash = std::strrchr(argv[0], '/');
+        opts.suite_name = slash != nullptr ? slash + 1 : argv[0];
+    }
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        auto value = [&](const char *flag) -> const char * {
+            std::size_t n = std::strlen(flag);
+            return std::strncmp(arg, flag, n) == 0 ? arg + n : nullptr;
+        };
+        char *end = nullptr;
+        if (const char *v = value("--filter="))
+            opts.filter = v;
+        else if (const char *v = value("--shard="))
+        {
+            opts.shard_index = std::strtoul(v, &end, 10);
+            if (end == v || *end != '/')
+                return false;
+            v = end + 1;
+            opts.shard_count = std::strtoul(v, &end, 10);
+            if (end == v || *end != '\0' || opts.shard_index >= opts.shard_count)
+                return false;
+        }
+        else if (const char *v = value("--jobs="))
+        {
+            opts.jobs = std::strtoul(v, &end, 10);
+            if (end == v || *end != '\0' || opts.jobs == 0)
+                return false;
+        }
+        else if (const char *v = value("--timeout-ms="))
+        {
+            opts.timeout_ms = std::strtoull(v, &end, 10);
+            if (end == v || *end != '\0')
+                return false;
+        }
+        else if (const char *v = value("--max-rss-mb="))
+        {
+            opts.max_rss_kb = std::strtoull(v, &end, 10) * 1024;
+            if (end == v || *end != '\0')
+                return false;
+        }
+        else if (const char *v = value("--max-allocations="))
+        {
+            opts.max_allocations = std::strtoull(v, &end, 10);
+            if (end == v || *end != '\0')
+                return false;
+        }
+        else if (const char *v = value("--cache="))
+            opts.cache_path = v;
+        else if (const char *v = value("--junit="))
+            opts.junit_path = v;
+        else if (const char *v = value("--tap="))
+            opts.tap_path = v;
+        else if (const char *v = value("--jsonl="))
+            opts.jsonl_path = v;
+        else if (std::strcmp(arg, "--threads") == 0)
+            opts.threads = true;
+        else if (std::strcmp(arg, "--list") == 0)
+            opts.list = true;
+        else if (std::strcmp(arg, "--failed-first") == 0)
+            opts.failed_first = true;
+        else if (std::strcmp(arg, "--only-changed") == 0)
+            opts.only_changed = true;
+        else
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief
+ *  Command line entry point for programs built from `ASSERTIFY_TEST`s; the
+ *  test support library calls it from its `main`. Returns 0 if every
+ *  selected test passed, 1 if any failed and 2 on bad usage.
+ *
+ *  @code
+ *  test_foo --shard=1/4 --jobs=8 --filter='parse_*:-parse_slow'
+ *  test_foo --only-changed --failed-first
+ *  test_foo --timeout-ms=5000 --max-rss-mb=256 --max-allocations=100000
+ *  test_foo --junit=results.xml --tap=results.tap --jsonl=results.jsonl
+ *  @endcode
+ */
+inline int test_main(int argc, char *argv[])
+{
+    test_options opts;
+    if (!parse_test_options(argc, argv, opts))
+    {
+        std::fprintf(stderr,
+                     "usage: %s [--filter=GLOB[:GLOB...]] [--shard=INDEX/COUNT] [--jobs=N]"
+                     " [--threads] [--list] [--cache=FILE] [--failed-first] [--only-changed]"
+                     " [--timeout-ms=N] [--max-rss-mb=N] [--max-allocations=N]"
+                     " [--junit=FILE] [--tap=FILE] [--jsonl=FILE]\n",
+                     argc > 0 ? argv[0] : "test");
+        return 2;
+    }
+    std::size_t unchanged = 0;
+    std::vector<const test_case *> tests = plan_tests(opts, &unchanged);
+    if (opts.list)
+    {
+        for (const test_case *test : tests)
+            std::printf("%s\n", test->name);
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<test_result> results = run_tests(tests, opts);
+    std::string failed;
+    std::size_t failures = 0;
+    for (const test_result &r : results)
+    {
+        if (r.passed)
+            continue;
+        ++failures;
+        failed += std::string("Failed:\t\t") + r.test->name + "\n";
+    }
+    char summary[128];
+    std::snprintf(summary, sizeof(summary), "%zu test(s), %zu failed, %zu unchanged, shard %zu/%zu, %.1f ms\n",
+                  results.size(), failures, unchanged, opts.shard_index, opts.shard_count,
+                  static_cast<double>(detail::since(start)) / 1e6);
+    std::string report = summary + failed;
+    detail::write_report(report.data(), report.size());
+    return failures == 0 ? 0 : 1;
+}
+} // namespace assertify
+
+/**
+ * @brief
+ *  Runs `stmt` in a forked child and checks that the child ends as `status`
+ *  describes (`assertify::exited_with(code)`, `assertify::killed_by(signal)`
+ *  or `assertify::died()`) and that its stderr contains a match for the
+ *  ECMAScript `regex`. A mismatch is reported as "Death test failed" and
+ *  counted in `assertify::test_failures()`.
+ */
+#define ASSERTIFY_EXPECT_EXIT(stmt, status, regex)                                \
+    ::assertify::detail::expect_death({#stmt, ASSERTIFY_FILE, __LINE__, (status), \
+                                       (regex)},                                  \
+                                      [&]() { stmt; })
+
+/**
+ * @brief
+ *  Runs `stmt` in a forked child and checks that the child is killed by a
+ *  signal or exits with a non-zero status, with stderr matching `regex`.
+ */
+#define ASSERTIFY_EXPECT_DEATH(stmt, regex) \
+    ASSERTIFY_EXPECT_EXIT(stmt, ::assertify::died(), regex)
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+#define ASSERTIFY_TEST_FILE ASSERTIFY_FILE
+#else
+// ASSERTIFY_FILE is not a constant expression before C++20
+#define ASSERTIFY_TEST_FILE __FILE__
+#endif
+
+/**
+ * @brief
+ *  Defines a test. Its description is constant-initialized into the
+ *  `assertify_tests` section, so no code runs before `main` to register it.
+ *  The test function goes in a section of its own, which keeps a change to
+ *  one test from moving shared code and changing every test's code hash.
+ *  A test fails if it crashes, throws, fails an assertion or a death test.
+ *
+ *  @code
+ *  ASSERTIFY_TEST(parse_rejects_negative)
+ *  {
+ *      ASSERTIFY_EXPECT_DEATH(parse(-1), "input is negative");
+ *  }
+ *  @endcode
+ */
+#define ASSERTIFY_TEST(name)                                                                      \
+    __attribute__((section("assertify_test_code"))) static void assertify_test_##name();          \
+    __attribute__((section("assertify_tests"), used)) static constexpr ::assertify::test_case     \
+        assertify_test_case_##name{#name, ASSERTIFY_TEST_FILE, __LINE__, &assertify_test_##name}; \
+    static void assertify_test_##name()
+
+/**
+ * @brief
+ *  Replaces the global `operator new` and `operator delete` with versions
+ *  that count allocations, which enables `--max-allocations` and the
+ *  allocation counts in test reports. Expand it at namespace scope in
+ *  exactly one source file of a test program.
+ */
+#define ASSERTIFY_TEST_COUNT_ALLOCATIONS()                                                              \
+    extern "C" const bool assertify_counts_allocations = true;                                          \
+    void *operator new(std::size_t size)                                                                \
+    {                                                                                                   \
+        ::assertify::detail::count_allocation();                                                        \
+        if (void *p = std::malloc(size == 0 ? 1 : size))                                                \
+            return p;                                                                                   \
+        throw std::bad_alloc();                                                                         \
+    }                                                                                                   \
+    void *operator new(std::size_t size, std::align_val_t align)                                        \
+    {                                                                                                   \
+        ::assertify::detail::count_allocation();                                                        \
+        std::size_t alignment = static_cast<std::size_t>(align);                                        \
+        std::size_t rounded = (std::max<std::size_t>(size, 1) + alignment - 1) / alignment * alignment; \
+        if (void *p = std::aligned_alloc(alignment, rounded))                                           \
+            return p;                                                                                   \
+        throw std::bad_alloc();                                                                         \
+    }                                                                                                   \
+    void operator delete(void *p) noexcept { std::free(p); }                                            \
+    void operator delete(void *p, std::size_t) noexcept { std::free(p); }                               \
+    void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }                          \
+    void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+#endif /* End of include guard: ASSERTIFY_TEST_HPP_c4n8w1 */
@@ -0,0 +1,33 @@
+// Built twice, with TEST_EDITED set to 0 and 1, to check that editing one
+// test leaves the code hashes of the others unchanged
+#include "assertify_test.hpp"
+
+#include <cstdio>
+
+ASSERTIFY_TEST(before)
+{
+    volatile int x = 1;
+    ASSERT_ABORT(x == 1, "before");
+}
+
+ASSERTIFY_TEST(edited)
+{
+    volatile int x = 1;
+#if TEST_EDITED
+    ASSERT_ABORT(x * 3 + 1 >= 2 && x < 100, "edited, with a longer condition");
+#else
+    ASSERT_ABORT(x == 1, "edited");
+#endif
+}
+
+ASSERTIFY_TEST(after)
+{
+    volatile int x = 1;
+    ASSERT_ABORT(x == 1, "after");
+}
+
+int main()
+{
+    for (const assertify::test_case *t : assertify::registered_tests())
+        std::printf("%s %016llx\n", t->name, static_cast<unsigned long long>(assertify::detail::code_hash(*t)));
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""Checks the machine code of the reference functions in codegen.hpp.
+
+For every assertion mode, with the unchecked "none" functions as baseline:
+
+- codegen_<mode>_one: the passing path, i.e. the whole hot body since failure
+  code is split out, has at most `extra` more instructions than the baseline,
+  and calls nothing except `allowed_calls`,
+- every branch out of it lands in .text.unlikely, and no failure code is left
+  in the hot section after its return,
+- codegen_<mode>_sites: the hot and cold bytes per site stay within budget.
+
+The budgets are the x86-64 GCC -O2 code of the current header plus headroom;
+a failure means a change made the passing path or the per-site cost bigger.
+"""
+
+import argparse
+import collections
+import re
+import subprocess
+import sys
+
+SITES = 16
+
+# mode: (extra passing-path instructions, calls allowed on it,
+#        hot bytes per site, cold bytes per site)
+BUDGETS = {
+    "abort": (2, (), 16, 16),
+    "static_abort": (2, (), 16, 96),
+    "exception": (2, (), 16, 72),
+    # Returns after a failure, so the value live across the call costs a spill.
+    "check": (5, (), 16, 56),
+    "expect": (5, (), 16, 24),
+    # setjmp runs on every check by design.
+    "long_jump": (12, ("_setjmp",), 64, 32),
+}
+
+Instruction = collections.namedtuple("Instruction", "mnemonic operands reloc")
+
+HEADER = re.compile(r"^[0-9a-f]+ <(\S+)>:$")
+LINE = re.compile(r"^\s*[0-9a-f]+:\t(\S+)\s*([^\t]*)(?:\t[0-9a-f]+: (R_\S+)\t(\S+))?")
+SYMBOL = re.compile(r"^[0-9a-f]+ .{7} (\S+)\t([0-9a-f]+) (\S+)$")
+
+
+def disassemble(objdump, objects):
+    """Instructions of every function symbol, and (section, size) of every symbol."""
+    functions, current = {}, None
+    out = subprocess.run([objdump, "-dr", "-w", "--no-show-raw-insn"] + objects,
+                         capture_output=True, text=True, check=True).stdout
+    for line in out.splitlines():
+        header = HEADER.match(line)
+        if header:
+            current = functions.setdefault(header.group(1), [])
+            continue
+        insn = LINE.match(line)
+        if insn and current is not None:
+            reloc = insn.group(4) if insn.group(3) else None
+            current.append(Instruction(insn.group(1), insn.group(2).strip(), reloc))
+
+    symbols = {}
+    out = subprocess.run([objdump, "-t"] + objects, capture_output=True, text=True,
+                         check=True).stdout
+    for line in out.splitlines():
+        symbol = SYMBOL.match(line)
+        if symbol:
+            symbols[symbol.group(3)] = (symbol.group(1), int(symbol.group(2), 16))
+    return functions, symbols
+
+
+PADDING = ("nop", "data16", "xchg", "int3", "cs")
+
+
+def body(functions, name):
+    """Instructions of `name` up to its last return, and any code after it."""
+    insns = functions[name]
+    last_ret = max(i for i, insn in enumerate(insns) if insn.mnemonic.startswith("ret"))
+    tail = [i for i in insns[last_ret + 1:] if not i.mnemonic.startswith(PADDING)]
+    return insns[:last_ret + 1], tail
+
+
+def is_conditional_branch(insn):
+    return insn.mnemonic.startswith("j") and insn.mnemonic != "jmp"
+
+
+def check(functions, symbols, out):
+    errors = []
+    baseline = len(body(functions, "codegen_none_one")[0])
+    none_bytes = symbols["codegen_none_sites"][1]
+    out.write("%-14s %6s %12s %16s %16s\n" %
+              ("mode", "insns", "first call", "hot bytes/site", "cold bytes/site"))
+    for mode, (extra, allowed_calls, hot_budget, cold_budget) in BUDGETS.items():
+        one = "codegen_%s_one" % mode
+        sites = "codegen_%s_sites" % mode
+        insns, tail = body(functions, one)
+        if tail:
+            errors.append("%s: %d instructions of failure code in the hot section" %
+                          (one, len(tail)))
+
+        calls = [i.reloc or i.operands for i in insns if i.mnemonic.startswith("call")]
+        for call in calls:
+            if not any(call.startswith(name) for name in allowed_calls):
+                errors.append("%s: calls %s on the passing path" % (one, call))
+        first_branch = next(n for n, i in enumerate(insns) if is_conditional_branch(i))
+        first_call = next((n for n, i in enumerate(insns) if i.mnemonic.startswith("call")), None)
+        if first_call is not None and first_call < first_branch and not allowed_calls:
+            errors.append("%s: call before the first branch" % one)
+
+        for insn in insns:
+            if is_conditional_branch(insn) and insn.reloc is not None and \
+                    not insn.reloc.startswith(".text.unlikely"):
+                errors.append("%s: failure branch goes to %s, not .text.unlikely" %
+                              (one, insn.reloc))
+        if len(insns) > baseline + extra:
+            errors.append("%s: %d instructions on the passing path, budget %d" %
+                          (one, len(insns), baseline + extra))
+
+        hot = (symbols[sites][1] - none_bytes) / SITES
+        cold_section, cold_size = symbols.get(sites + ".cold", (".text.unlikely", 0))
+        cold = cold_size / SITES
+        if not cold_section.startswith(".text.unlikely"):
+            errors.append("%s.cold is in %s" % (sites, cold_section))
+        if hot > hot_budget:
+            errors.append("%s: %.1f hot bytes per site, budget %d" % (sites, hot, hot_budget))
+        if cold > cold_budget:
+            errors.append("%s: %.1f cold bytes per site, budget %d" % (sites, cold, cold_budget))
+
+        out.write("%-14s %6d %12s %16.1f %16.1f\n" %
+                  (mode, len(insns), "-" if first_call is None else "#%d" % first_call, hot,
+                   cold))
+    return errors
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--objdump", default="objdump")
+    parser.add_argument("objects", nargs="+", help="objects built from the codegen sources")
+    args = parser.parse_args()
+
+    # $<TARGET_OBJECTS> reaches add_test as one ';'-separated argument
+    objects = [path for arg in args.objects for path in arg.split(";")]
+    functions, symbols = disassemble(args.objdump, objects)
+    errors = check(functions, symbols, sys.stdout)
+    for error in errors:
+        sys.stdout.write("FAILED: %s\n" % error)
+    if not errors:
+        sys.stdout.write("codegen ok\n")
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
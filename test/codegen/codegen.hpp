@@ -0,0 +1,44 @@
+/**
+ * @file codegen.hpp
+ *
+ * @brief
+ *  Reference functions whose machine code check_codegen.py inspects. The
+ *  including file defines `CODEGEN_ASSERT(mode, expr)` and calls
+ *  `CODEGEN_REFERENCE(mode)` once per assertion mode, which defines:
+ *
+ *  - `codegen_<mode>_one(x)`: one check, then `x * 3`,
+ *  - `codegen_<mode>_sites(v)`: 16 checks on distinct elements, then a sum.
+ *
+ *  `CODEGEN_REFERENCE(none)` with a no-op check gives the baseline the other
+ *  modes are measured against.
+ */
+
+#ifndef ASSERTIFY_CODEGEN_HPP
+#define ASSERTIFY_CODEGEN_HPP
+
+#define CODEGEN_SITES_4(mode, i)                                                             \
+    CODEGEN_ASSERT(mode, v[i] > 0);                                                          \
+    CODEGEN_ASSERT(mode, v[i + 1] > 0);                                                      \
+    CODEGEN_ASSERT(mode, v[i + 2] > 0);                                                      \
+    CODEGEN_ASSERT(mode, v[i + 3] > 0)
+
+#define CODEGEN_REFERENCE(mode)                                                              \
+    extern "C" int codegen_##mode##_one(int x)                                               \
+    {                                                                                        \
+        CODEGEN_ASSERT(mode, x > 0);                                                         \
+        return x * 3;                                                                        \
+    }                                                                                        \
+                                                                                             \
+    extern "C" int codegen_##mode##_sites(const int *v)                                      \
+    {                                                                                        \
+        CODEGEN_SITES_4(mode, 0);                                                            \
+        CODEGEN_SITES_4(mode, 4);                                                            \
+        CODEGEN_SITES_4(mode, 8);                                                            \
+        CODEGEN_SITES_4(mode, 12);                                                           \
+        int sum = 0;                                                                         \
+        for (int i = 0; i < 16; ++i)                                                         \
+            sum += v[i];                                                                     \
+        return sum;                                                                          \
+    }
+
+#endif /* ASSERTIFY_CODEGEN_HPP */
@@ -0,0 +1,25 @@
+/**
+ * @file codegen_assert.cpp
+ *
+ * @brief
+ *  Reference functions for every assertion mode that can share a translation
+ *  unit, plus the unchecked baseline.
+ */
+
+#include "assertify.hpp"
+#include "codegen.hpp"
+
+#define CODEGEN_CHECK_none(expr) (void)0
+#define CODEGEN_CHECK_abort(expr) ASSERT_ABORT(expr, "codegen")
+#define CODEGEN_CHECK_static_abort(expr) ASSERTIFY_ASSERT_ABORT(expr, "codegen")
+#define CODEGEN_CHECK_exception(expr) ASSERTIFY_ASSERT_EXCEPTION(expr, "codegen")
+#define CODEGEN_CHECK_check(expr) ASSERTIFY_CHECK(expr, "codegen")
+#define CODEGEN_CHECK_expect(expr) ASSERTIFY_EXPECT(expr, "codegen")
+#define CODEGEN_ASSERT(mode, expr) CODEGEN_CHECK_##mode(expr)
+
+CODEGEN_REFERENCE(none)
+CODEGEN_REFERENCE(abort)
+CODEGEN_REFERENCE(static_abort)
+CODEGEN_REFERENCE(exception)
+CODEGEN_REFERENCE(check)
+CODEGEN_REFERENCE(expect)
@@ -0,0 +1,15 @@
+/**
+ * @file codegen_long_jump.cpp
+ *
+ * @brief
+ *  Reference functions for `ASSERTIFY_ASSERT_EXCEPTION` built with
+ *  ASSERTIFY_LONG_JMP_ENDABLED, which is selected per translation unit.
+ */
+
+#define ASSERTIFY_LONG_JMP_ENDABLED
+#include "assertify.hpp"
+#include "codegen.hpp"
+
+#define CODEGEN_ASSERT(mode, expr) ASSERTIFY_ASSERT_EXCEPTION(expr, "codegen")
+
+CODEGEN_REFERENCE(long_jump)
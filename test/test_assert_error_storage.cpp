@@ -0,0 +1,36 @@
+#include "assertify.hpp"
+
+#include <cstring>
+#include <string>
+
+static AssertionError make_error()
+{
+    std::string msg = "request " + std::to_string(42) + " rejected";
+    std::string file = std::string("dynamic/") + "file.cpp";
+    return AssertionError("ok()", false, file.c_str(), 7, msg.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+    AssertionError e = make_error();
+    ASSERT_ABORT(std::strcmp(e.what(), "request 42 rejected") == 0, "message outlives its source");
+    ASSERT_ABORT(std::strcmp(e.file(), "dynamic/file.cpp") == 0, "file outlives its source");
+    ASSERT_ABORT(std::strcmp(e.expr_str(), "ok()") == 0 && e.line() == 7, "expression and line");
+
+    std::string long_msg(1000, 'x');
+    AssertionError t("x", false, __FILE__, __LINE__, long_msg.c_str());
+    std::size_t len = std::strlen(t.what());
+    ASSERT_ABORT(len == ASSERTIFY_ERROR_MSG_SIZE - 1, "long messages are truncated");
+    ASSERT_ABORT(std::strcmp(t.what() + len - 3, "...") == 0, "truncation is marked");
+
+    try
+    {
+        int n = 9, cap = 4;
+        throw AssertionError("n <= cap", false, __FILE__, __LINE__, "size {} > cap {}", n, cap);
+    }
+    catch (const AssertionError &caught)
+    {
+        AssertionError copy = caught;
+        ASSERT_ABORT(std::strcmp(copy.what(), "size 9 > cap 4") == 0, "formatted message");
+    }
+}
@@ -0,0 +1,28 @@
+#include "assertify.hpp"
+
+#include <cstring>
+
+int main(int argc, char *argv[])
+{
+    char buf[64];
+
+    assertify::format_to(buf, sizeof(buf), "size {} > cap {}", 12, 8u);
+    ASSERT_ABORT(std::strcmp(buf, "size 12 > cap 8") == 0, "integers");
+
+    assertify::format_to(buf, sizeof(buf), "{} {} {} {}", true, 'c', "str", -1.5);
+    ASSERT_ABORT(std::strcmp(buf, "true c str -1.5") == 0, "mixed types");
+
+    assertify::format_to(buf, sizeof(buf), "{{}} {}", 1);
+    ASSERT_ABORT(std::strcmp(buf, "{} 1") == 0, "escaped braces");
+
+    char small[8];
+    std::size_t n = assertify::format_to(small, sizeof(small), "{}", "0123456789");
+    ASSERT_ABORT(n == 7 && std::strcmp(small, "0123...") == 0, "truncation");
+
+    int calls = 0;
+    auto count = [&calls]() { return ++calls; };
+    ASSERTIFY_ASSERT_FMT(argc > 0, "argc was {}, calls {}", argc, count());
+    ASSERT_ABORT(calls == 0, "arguments must not be evaluated on success");
+
+    ASSERTIFY_ASSERT_FMT(argc > 0, "no placeholders");
+}
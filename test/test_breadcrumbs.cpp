@@ -0,0 +1,83 @@
+#define ASSERTIFY_BREADCRUMBS_ENABLED
+#include "assertify.hpp"
+
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+
+static void first(int i) { ASSERT_ABORT(i >= 0, "first"); }
+
+static void second(int i) { ASSERTIFY_CHECK(i < 1000, "second"); }
+
+static std::string fail_in_child(void (*fn)())
+{
+    FILE *capture = std::tmpfile();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(fileno(capture), 2);
+        fn();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    std::string text(8192, '\0');
+    text.resize(static_cast<std::size_t>(pread(fileno(capture), text.data(), text.size(), 0)));
+    return text;
+}
+
+static void check_ring()
+{
+    first(1);
+    second(2);
+
+    assertify::breadcrumb crumbs[ASSERTIFY_BREADCRUMB_DEPTH];
+    ASSERT_ABORT(assertify::recent_breadcrumbs(crumbs, 4) == 2, "one breadcrumb per pass");
+    const assertify::site_info *latest = assertify::find_site(crumbs[0].site_id);
+    const assertify::site_info *earlier = assertify::find_site(crumbs[1].site_id);
+    ASSERT_ABORT(latest != nullptr && std::strcmp(latest->expr_str, "i < 1000") == 0,
+                 "most recent first");
+    ASSERT_ABORT(earlier != nullptr && std::strcmp(earlier->expr_str, "i >= 0") == 0, "order");
+    ASSERT_ABORT(std::strcmp(earlier->file, "test/test_breadcrumbs.cpp") == 0, "file");
+    ASSERT_ABORT(crumbs[0].tsc >= crumbs[1].tsc, "time stamps");
+
+    for (int i = 0; i < 3 * ASSERTIFY_BREADCRUMB_DEPTH; ++i)
+        first(i);
+    ASSERT_ABORT(assertify::recent_breadcrumbs(crumbs, ASSERTIFY_BREADCRUMB_DEPTH) ==
+                     ASSERTIFY_BREADCRUMB_DEPTH,
+                 "ring keeps the last passes");
+    ASSERT_ABORT(crumbs[0].site_id == earlier->id, "ring wraps around");
+
+    std::thread([] {
+        assertify::breadcrumb none[1];
+        ASSERT_ABORT(assertify::recent_breadcrumbs(none, 1) == 0, "rings are per thread");
+    }).join();
+}
+
+static void check_dump()
+{
+    std::string text = fail_in_child([] {
+        first(1);
+        second(2);
+        ASSERT_ABORT(sizeof(int) == 3, "boom");
+    });
+    std::size_t dump = text.find("Breadcrumbs:\t");
+    ASSERT_ABORT(dump != std::string::npos, "dumped with the report");
+    std::size_t latest = text.find("test/test_breadcrumbs.cpp:10\ti < 1000\n", dump);
+    std::size_t earlier = text.find("test/test_breadcrumbs.cpp:8\ti >= 0\n", dump);
+    ASSERT_ABORT(latest != std::string::npos && earlier != std::string::npos && latest < earlier,
+                 "most recent first");
+
+    text = fail_in_child([] {
+        first(1);
+        ASSERTIFY_ASSERT_EXCEPTION(sizeof(int) == 3, "exception");
+    });
+    ASSERT_ABORT(text.find("Assertion failed: exception") < text.find("Breadcrumbs:\t"),
+                 "AssertionError handling dumps them too");
+}
+
+int main(int argc, char *argv[])
+{
+    check_ring();
+    check_dump();
+}
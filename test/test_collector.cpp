@@ -0,0 +1,64 @@
+#include "assertify.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/wait.h>
+
+static void fail_in_child(const char *path)
+{
+    pid_t child = fork();
+    if (child == 0)
+    {
+        assertify::connect_collector(path);
+        ASSERT_ABORT(path == nullptr, "reported to the collector");
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    // With a path argument, only send failures to an assertify-collectord
+    if (argc > 1)
+    {
+        fail_in_child(argv[1]);
+        fail_in_child(argv[1]);
+        return 0;
+    }
+
+    const char *path = "test_collector.sock";
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path);
+    unlink(path);
+    int receiver = socket(AF_UNIX, SOCK_DGRAM, 0);
+    ASSERT_ABORT(bind(receiver, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0, "bind");
+
+    fail_in_child(path);
+    pollfd pfd{receiver, POLLIN, 0};
+    ASSERT_ABORT(poll(&pfd, 1, 2000) == 1, "a datagram arrives");
+    char buf[assertify::collector_datagram_size];
+    ssize_t n = recv(receiver, buf, sizeof(buf), 0);
+    assertify::collector_message message;
+    ASSERT_ABORT(assertify::decode_collector_message(buf, n, message), "datagram decodes");
+    ASSERT_ABORT(message.file == "test/test_collector.cpp", "file");
+    ASSERT_ABORT(message.expr_str == "path == nullptr", "expression");
+    ASSERT_ABORT(message.msg == "reported to the collector", "message");
+    ASSERT_ABORT(message.header.site_id ==
+                     assertify::detail::site_id(message.file, message.header.line),
+                 "site id");
+
+    // Nobody reads the socket any more: sends must drop instead of blocking
+    ASSERT_ABORT(assertify::connect_collector(path), "connect");
+    assertify::detail::failure f{"x", "file.cpp", 1, "flood"};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10000; ++i)
+        assertify::detail::send_to_collector(f, nullptr, 0);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_ABORT(assertify::collector_dropped() > 0, "full socket drops datagrams");
+    ASSERT_ABORT(elapsed < std::chrono::seconds(2), "sending never blocks");
+
+    close(receiver);
+    unlink(path);
+}
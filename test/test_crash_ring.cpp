@@ -0,0 +1,44 @@
+#include "assertify.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <sys/wait.h>
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "test_crash_ring.bin";
+    ASSERT_ABORT(assertify::open_crash_ring(path, 4), "crash ring opens");
+
+    int n = 300, cap = 256;
+    pid_t child = fork();
+    if (child == 0)
+        ASSERTIFY_ASSERT_FMT(n <= cap, "size {} > cap {}", n, cap);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    ASSERT_ABORT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "child aborts");
+    assertify::close_crash_ring();
+
+    // Read the record back from the file the aborted child wrote into
+    std::FILE *file = std::fopen(path, "rb");
+    assertify::crash_ring_header header;
+    assertify::crash_record record;
+    ASSERT_ABORT(file != nullptr, "crash ring file exists");
+    ASSERT_ABORT(std::fread(&header, sizeof(header), 1, file) == 1, "header");
+    ASSERT_ABORT(std::fread(&record, sizeof(record), 1, file) == 1, "record");
+    std::fclose(file);
+
+    ASSERT_ABORT(std::memcmp(header.magic, assertify::crash_ring_magic, 8) == 0, "magic");
+    ASSERT_ABORT(header.next.load() == 1 && header.capacity == 4, "one record claimed");
+    ASSERT_ABORT(record.sequence.load() == 1, "record is complete");
+    ASSERT_ABORT(std::strcmp(record.msg, "size 300 > cap 256") == 0, "message");
+    ASSERT_ABORT(std::strcmp(record.expr_str, "n <= cap") == 0, "expression");
+    ASSERT_ABORT(std::strcmp(record.file, "test/test_crash_ring.cpp") == 0, "file");
+    ASSERT_ABORT(record.site_id == assertify::detail::site_id(record.file, record.line), "site id");
+    ASSERT_ABORT(record.thread_id == static_cast<std::uint64_t>(child), "thread id");
+
+    int operands[2];
+    ASSERT_ABORT(record.operand_size == sizeof(operands), "operand bytes");
+    std::memcpy(operands, record.operands, sizeof(operands));
+    ASSERT_ABORT(operands[0] == 300 && operands[1] == 256, "operand values");
+}
@@ -0,0 +1,49 @@
+#include "assertify_test.hpp"
+
+#include <sys/mman.h>
+
+static void check_positive(int v)
+{
+    ASSERT_ABORT(v > 0, "v must be positive");
+}
+
+int main(int argc, char *argv[])
+{
+    int v = -1;
+    ASSERTIFY_EXPECT_DEATH(check_positive(v), "Assert failed:\tv must be positive");
+    ASSERTIFY_EXPECT_EXIT(check_positive(v), assertify::killed_by(SIGABRT), "Source:\t\t");
+    ASSERTIFY_EXPECT_EXIT(std::exit(3), assertify::exited_with(3), "");
+    ASSERT_ABORT(assertify::test_failures() == 0, "matching deaths pass");
+
+    // Each of these fails and is reported
+    ASSERTIFY_EXPECT_DEATH(check_positive(1), "");
+    ASSERTIFY_EXPECT_DEATH(check_positive(v), "no such message");
+    ASSERTIFY_EXPECT_EXIT(check_positive(v), assertify::exited_with(1), "");
+    ASSERT_ABORT(assertify::test_failures() == 3, "mismatches are counted");
+
+    // Sixteen 100 ms deaths on eight slots take two rounds, never more than eight at once
+    auto *slots = static_cast<std::atomic<int> *>(::mmap(nullptr, 2 * sizeof(std::atomic<int>),
+                                                         PROT_READ | PROT_WRITE,
+                                                         MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    std::atomic<int> &running = slots[0], &peak = slots[1];
+    auto start = std::chrono::steady_clock::now();
+    {
+        assertify::death_pool pool(8);
+        for (int i = 0; i < 16; ++i)
+            ASSERTIFY_EXPECT_DEATH(
+                {
+                    int now = running.fetch_add(1) + 1;
+                    for (int seen = peak.load(); seen < now && !peak.compare_exchange_weak(seen, now);)
+                    {
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    running.fetch_sub(1);
+                    check_positive(-i);
+                },
+                "v must be positive");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ASSERT_ABORT(assertify::test_failures() == 3, "pooled deaths pass");
+    ASSERT_ABORT(peak.load() > 1 && peak.load() <= 8, "children run in parallel, bounded");
+    ASSERT_ABORT(elapsed < std::chrono::milliseconds(1200), "pooled deaths overlap");
+}
@@ -0,0 +1,128 @@
+#include "assertify_test.hpp"
+
+#include <cstring>
+#include <string>
+
+constexpr int kThreads = 8;
+constexpr int kIterations = 100;
+
+static std::size_t buffer_count()
+{
+    std::size_t n = 0;
+    auto &rings = assertify::detail::g_rings<assertify::detail::expect_ring>;
+    for (auto *ring = rings.load(); ring; ring = ring->next)
+        ++n;
+    return n;
+}
+
+static const assertify::expect_summary *find(const std::vector<assertify::expect_summary> &summaries,
+                                             const char *msg)
+{
+    for (const auto &summary : summaries)
+    {
+        if (std::strcmp(summary.site->msg, msg) == 0)
+            return &summary;
+    }
+    return nullptr;
+}
+
+static void fail_in_threads()
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([] {
+            for (int i = 0; i < kIterations; ++i)
+                ASSERTIFY_EXPECT(i < 0, "worker expectation");
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+}
+
+static void check_aggregation()
+{
+    fail_in_threads();
+    for (int i = 0; i < 3; ++i)
+        ASSERTIFY_EXPECT(i > 10, "main expectation");
+    ASSERTIFY_EXPECT(true, "never recorded");
+
+    std::vector<assertify::expect_summary> summaries = assertify::drain();
+    ASSERT_ABORT(summaries.size() == 2, "one summary per failing site");
+    const assertify::expect_summary *worker = find(summaries, "worker expectation");
+    const assertify::expect_summary *main = find(summaries, "main expectation");
+    ASSERT_ABORT(worker != nullptr && worker->count == kThreads * kIterations,
+                 "records of exited threads are drained");
+    ASSERT_ABORT(main != nullptr && main->count == 3, "main thread records");
+    ASSERT_ABORT(std::strcmp(main->site->expr_str, "i > 10") == 0, "expression");
+    ASSERT_ABORT(std::strcmp(main->site->file, "test/test_expect.cpp") == 0, "file");
+    ASSERT_ABORT(main->first_ns <= main->last_ns, "timestamps");
+    ASSERT_ABORT(assertify::drain().empty(), "records are consumed once");
+}
+
+static void check_buffer_reuse()
+{
+    std::size_t before = buffer_count();
+    fail_in_threads();
+    ASSERT_ABORT(buffer_count() == before, "buffers of exited threads are adopted");
+    ASSERT_ABORT(find(assertify::drain(), "worker expectation")->count == kThreads * kIterations,
+                 "adopted buffers keep every record");
+}
+
+static void check_overflow()
+{
+    constexpr int failures = ASSERTIFY_EXPECT_BUFFER_SIZE + 44;
+    std::uint64_t dropped = assertify::expect_dropped();
+    for (int i = 0; i < failures; ++i)
+        ASSERTIFY_EXPECT(i < 0, "overflowing expectation");
+    ASSERT_ABORT(assertify::expect_dropped() - dropped == 44, "full buffer drops records");
+    ASSERT_ABORT(find(assertify::drain(), "overflowing expectation")->count ==
+                     ASSERTIFY_EXPECT_BUFFER_SIZE,
+                 "buffer keeps its capacity");
+}
+
+static void check_flusher()
+{
+    FILE *capture = std::tmpfile();
+    int saved = dup(2);
+    dup2(fileno(capture), 2);
+
+    ASSERT_ABORT(assertify::start_expect_flusher(std::chrono::milliseconds(5)), "flusher starts");
+    ASSERT_ABORT(!assertify::start_expect_flusher(), "only one flusher");
+    for (int i = 0; i < 5; ++i)
+        ASSERTIFY_EXPECT(i < 0, "flushed expectation");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assertify::stop_expect_flusher();
+
+    dup2(saved, 2);
+    std::string text;
+    char buf[4096];
+    ssize_t n;
+    lseek(fileno(capture), 0, SEEK_SET);
+    while ((n = read(fileno(capture), buf, sizeof(buf))) > 0)
+        text.append(buf, static_cast<std::size_t>(n));
+    ASSERT_ABORT(text.find("Expect failed:\tflushed expectation\n") != std::string::npos,
+                 "flusher reports the site");
+    ASSERT_ABORT(text.find("Failures:\t5\n") != std::string::npos, "with its failure count");
+}
+
+static void exit_with_flusher()
+{
+    assertify::start_expect_flusher(std::chrono::hours(1));
+    for (int i = 0; i < 3; ++i)
+        ASSERTIFY_EXPECT(i < 0, "pending at exit");
+    std::exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    check_aggregation();
+    check_buffer_reuse();
+    check_overflow();
+    check_flusher();
+
+    // Exiting with the flusher running stops it and reports what is pending
+    ASSERTIFY_EXPECT_EXIT(exit_with_flusher(), assertify::exited_with(0),
+                          "Expect failed:\tpending at exit\n[^]*Failures:\t3\n");
+    ASSERT_ABORT(assertify::test_failures() == 0, "pending failures are reported at exit");
+}
@@ -0,0 +1,166 @@
+#include "assertify.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+
+constexpr int kThreads = 64;
+constexpr int kIterations = 2000;
+
+static std::string read_fd(int fd)
+{
+    std::string text;
+    char buf[4096];
+    ssize_t n;
+    lseek(fd, 0, SEEK_SET);
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+        text.append(buf, static_cast<std::size_t>(n));
+    return text;
+}
+
+static std::size_t count(const std::string &text, const char *needle)
+{
+    std::size_t n = 0;
+    for (std::size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+        ++n;
+    return n;
+}
+
+static void check_rate_limited_storm()
+{
+    FILE *capture = std::tmpfile();
+    int saved = dup(2);
+    dup2(fileno(capture), 2);
+
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < kThreads; ++t)
+    {
+        threads.emplace_back([&go] {
+            while (!go.load())
+                std::this_thread::yield();
+            for (int i = 0; i < kIterations; ++i)
+                ASSERTIFY_CHECK(i < 0, "invariant broken in a hot loop");
+        });
+    }
+    go = true;
+    for (auto &thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    dup2(saved, 2);
+    std::string text = read_fd(fileno(capture));
+    std::size_t reports = count(text, "Check failed:");
+    double bound = ASSERTIFY_RATE_LIMIT_BURST + seconds * 1000 / ASSERTIFY_RATE_LIMIT_INTERVAL_MS + 1;
+
+    std::printf("%d failures on %d threads in %.3f s (%.0f ns per failure), %zu reports\n",
+                kThreads * kIterations, kThreads, seconds,
+                seconds * 1e9 / (kThreads * kIterations), reports);
+    ASSERT_ABORT(reports >= 1 && reports <= bound, "reporting is bounded by the token bucket");
+}
+
+static void check_suppressed_at_exit()
+{
+    FILE *capture = std::tmpfile();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(fileno(capture), 2);
+        for (int i = 0; i < ASSERTIFY_RATE_LIMIT_BURST + 5; ++i)
+            ASSERTIFY_CHECK(i < 0, "fails in a burst, then goes quiet");
+        std::exit(0);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    std::string text = read_fd(fileno(capture));
+    ASSERT_ABORT(WIFEXITED(status) && WEXITSTATUS(status) == 0, "process exits normally");
+    ASSERT_ABORT(count(text, "fails in a burst") == ASSERTIFY_RATE_LIMIT_BURST + 1 &&
+                     text.find("Suppressed:\t5 more since the last report\n") != std::string::npos,
+                 "failures suppressed before exit are reported");
+}
+
+static void check_first_failure_wins()
+{
+    FILE *capture = std::tmpfile();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(fileno(capture), 2);
+        std::atomic<bool> go{false};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&go, t] {
+                while (!go.load())
+                    std::this_thread::yield();
+                ASSERT_ABORT(t < 0, "every thread fails at once");
+            });
+        }
+        go = true;
+        for (auto &thread : threads)
+            thread.join();
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    std::string text = read_fd(fileno(capture));
+    ASSERT_ABORT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "process aborts");
+    ASSERT_ABORT(count(text, "Assert failed:") == 1, "exactly one thread reports");
+}
+
+// Holds the fatal latch long enough for the other threads to fail meanwhile
+static void throw_failure(const assertify::failure_info &)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    throw std::runtime_error("fatal failure");
+}
+
+static void check_throwing_handler_releases()
+{
+    pid_t child = fork();
+    if (child == 0)
+    {
+        alarm(10);
+        assertify::set_handler(assertify::category::fatal, throw_failure);
+        std::atomic<bool> go{false};
+        std::atomic<int> caught{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t)
+        {
+            threads.emplace_back([&go, &caught, t] {
+                while (!go.load())
+                    std::this_thread::yield();
+                try
+                {
+                    ASSERT_ABORT(t < 0, "every thread fails at once");
+                }
+                catch (const std::runtime_error &)
+                {
+                    ++caught;
+                }
+            });
+        }
+        go = true;
+        for (auto &thread : threads)
+            thread.join();
+        _exit(caught == kThreads ? 0 : 1);
+    }
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    ASSERT_ABORT(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                 "every thread gets the latch in turn when the handler throws");
+}
+
+int main(int argc, char *argv[])
+{
+    check_rate_limited_storm();
+    check_suppressed_at_exit();
+    check_first_failure_wins();
+    check_throwing_handler_releases();
+}
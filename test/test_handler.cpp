@@ -0,0 +1,121 @@
+#include "assertify.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/wait.h>
+
+static std::atomic<int> g_calls_a{0};
+static std::atomic<int> g_calls_b{0};
+static std::atomic<std::uint64_t> g_soft_count{0};
+static assertify::failure_info g_last;
+
+static void record_a(const assertify::failure_info &info)
+{
+    g_last = info;
+    g_calls_a.fetch_add(1);
+}
+
+static void record_b(const assertify::failure_info &) { g_calls_b.fetch_add(1); }
+
+static void record_soft(const assertify::failure_info &info) { g_soft_count += info.count; }
+
+static void throw_error(const assertify::failure_info &info) { throw std::runtime_error(info.msg); }
+
+static void check_categories()
+{
+    ASSERT_ABORT(assertify::set_handler(assertify::category::recoverable, record_a) == nullptr,
+                 "no handler by default");
+    int n = 1;
+    ASSERTIFY_CHECK(n == 2, "handled check");
+    ASSERT_ABORT(g_calls_a == 1, "recoverable handler runs");
+    ASSERT_ABORT(g_last.kind == assertify::category::recoverable, "category");
+    ASSERT_ABORT(std::strcmp(g_last.msg, "handled check") == 0 && g_last.count == 1, "info");
+    ASSERT_ABORT(std::strcmp(g_last.file, "test/test_handler.cpp") == 0, "file");
+
+    assertify::set_handler(assertify::category::soft, record_soft);
+    for (int i = 0; i < 4; ++i)
+        ASSERTIFY_EXPECT(i < 0, "handled expectation");
+    assertify::flush_expectations();
+    ASSERT_ABORT(g_soft_count == 4, "soft handler receives the aggregated count");
+    ASSERT_ABORT(g_calls_a == 1, "handlers are per category");
+
+    ASSERT_ABORT(assertify::set_handler(assertify::category::recoverable, nullptr) == record_a,
+                 "previous handler is returned");
+    assertify::set_handler(assertify::category::soft, nullptr);
+}
+
+static void check_swap_while_failing()
+{
+    std::atomic<bool> done{false};
+    std::thread swapper([&done] {
+        for (int i = 0; !done.load(); ++i)
+            assertify::set_handler(assertify::category::recoverable,
+                                   i % 2 == 0 ? record_a : record_b);
+    });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+    {
+        threads.emplace_back([] {
+            for (int i = 0; i < 1000; ++i)
+                ASSERTIFY_CHECK(i < 0, "swapped while failing");
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+    done = true;
+    swapper.join();
+    assertify::set_handler(assertify::category::recoverable, nullptr);
+    ASSERT_ABORT(g_calls_a + g_calls_b >= 1 + ASSERTIFY_RATE_LIMIT_BURST,
+                 "every report reaches one of the handlers");
+}
+
+static void check_fatal_handler_throws()
+{
+    assertify::set_handler(assertify::category::fatal, throw_error);
+    for (int i = 0; i < 2; ++i)
+    {
+        bool caught = false;
+        try
+        {
+            ASSERT_ABORT(i < 0, "thrown by the handler");
+        }
+        catch (const std::runtime_error &e)
+        {
+            caught = std::strcmp(e.what(), "thrown by the handler") == 0;
+        }
+        ASSERT_ABORT(caught, "a throwing handler returns control to the caller");
+    }
+    assertify::set_handler(assertify::category::fatal, nullptr);
+}
+
+static void check_fatal_handler_returns()
+{
+    FILE *capture = std::tmpfile();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        dup2(fileno(capture), 2);
+        assertify::set_handler(assertify::category::fatal, [](const assertify::failure_info &) {
+            static const char text[] = "custom fatal handler\n";
+            ::write(2, text, sizeof(text) - 1);
+        });
+        ASSERTIFY_ASSERT_ABORT(sizeof(int) == 3, "fatal");
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    std::string text(4096, '\0');
+    text.resize(static_cast<std::size_t>(pread(fileno(capture), text.data(), text.size(), 0)));
+    ASSERT_ABORT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT, "process still aborts");
+    ASSERT_ABORT(text == "custom fatal handler\n", "handler replaces the report");
+}
+
+int main(int argc, char *argv[])
+{
+    check_categories();
+    check_swap_while_failing();
+    check_fatal_handler_throws();
+    check_fatal_handler_returns();
+}
@@ -1,8 +1,10 @@
 #define ASSERTIFY_LONG_JMP_ENDABLED
-#include "assertify.hpp"
+#include "assertify_test.hpp"
 
 int main(int argc, char *argv[])
 {
     int x = 0;
-    ASSERTIFY_ASSERT_EXCEPTION(x > 0, "x must be positive");
-}
\ No newline at end of file
+    ASSERTIFY_EXPECT_EXIT(ASSERTIFY_ASSERT_EXCEPTION(x > 0, "x must be positive"),
+                          assertify::exited_with(1), "Assertion failed: x must be positive");
+    return assertify::test_failures() == 0 ? 0 : 1;
+}
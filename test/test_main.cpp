@@ -1,6 +1,7 @@
-#include <cstdio>
+#include "assertify_test.hpp"
 
+// Entry point for tests defined with ASSERTIFY_TEST; files with their own main do not use it
 int main(int argc, char *argv[])
 {
-    (void)fprintf(stdout, "Main entrypoint for testing..!");
-}
\ No newline at end of file
+    return assertify::test_main(argc, argv);
+}
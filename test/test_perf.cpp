@@ -0,0 +1,73 @@
+#include "assertify.hpp"
+
+#include <cstring>
+#include <string>
+
+static volatile std::uint64_t sink;
+
+static std::chrono::nanoseconds thread_cpu_time()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+// Spins until the calling thread has used `duration` of CPU time, however
+// long that takes on a loaded machine
+static void spin(std::chrono::milliseconds duration)
+{
+    auto until = thread_cpu_time() + duration;
+    while (thread_cpu_time() < until)
+        for (int i = 0; i < 1000; ++i)
+            sink = sink + static_cast<std::uint64_t>(i);
+}
+
+int main(int argc, char *argv[])
+{
+    using assertify::perf_counter;
+
+    assertify::perf_counters start = assertify::read_perf_counters();
+    ASSERT_ABORT(start.source != assertify::perf_source::none, "counters on linux");
+    ASSERT_ABORT(start.has(perf_counter::task_clock_ns), "task clock is always available");
+    std::printf("perf source: %s\n",
+                assertify::perf_source_names[static_cast<unsigned>(start.source)].data());
+
+    for (int i = 0; i < 3; ++i)
+    {
+        assertify::perf_scope scope("spin");
+        spin(std::chrono::milliseconds(20));
+        assertify::perf_counters spent = scope.elapsed();
+        ASSERT_ABORT(spent[perf_counter::task_clock_ns] >= 10000000, "busy time is counted");
+        if (spent.source == assertify::perf_source::hardware &&
+            spent.has(perf_counter::instructions))
+            ASSERT_ABORT(spent[perf_counter::instructions] > 1000000, "instructions are counted");
+    }
+
+    {
+        // Counters are per thread: time spent by another thread is not ours
+        assertify::perf_scope scope("join");
+        std::thread worker(spin, std::chrono::milliseconds(100));
+        worker.join();
+        ASSERT_ABORT(scope.elapsed()[perf_counter::task_clock_ns] < 50000000,
+                     "the worker's time is not attributed to the joining thread");
+    }
+
+    std::vector<assertify::perf_region> regions = assertify::perf_region_snapshot();
+    ASSERT_ABORT(regions.size() == 2, "one entry per region");
+    ASSERT_ABORT(std::strcmp(regions[0].name, "spin") == 0 && regions[0].calls == 3,
+                 "scopes of a region add up");
+    ASSERT_ABORT(regions[0].total[perf_counter::task_clock_ns] >= 30000000, "totals add up");
+
+    FILE *capture = std::tmpfile();
+    assertify::print_perf_regions(fileno(capture));
+    std::string text(4096, '\0');
+    text.resize(static_cast<std::size_t>(pread(fileno(capture), text.data(), text.size(), 0)));
+    ASSERT_ABORT(text.rfind("Perf regions:\tsource ", 0) == 0, "header");
+    ASSERT_ABORT(text.find("task-clock-ns") != std::string::npos, "counter columns");
+    ASSERT_ABORT(text.find("             3 ") != std::string::npos, "calls column");
+    ASSERT_ABORT(text.find("  spin\n") != std::string::npos, "region rows");
+
+    assertify::reset_perf_regions();
+    ASSERT_ABORT(assertify::perf_region_snapshot().empty(), "reset forgets regions");
+    std::fputs(text.c_str(), stdout);
+}
@@ -0,0 +1,47 @@
+#define ASSERTIFY_PROFILE_ENABLED
+#include "assertify.hpp"
+
+#include <cstring>
+#include <string>
+
+static bool expensive(int n)
+{
+    volatile std::uint64_t sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum = sum + static_cast<std::uint64_t>(i);
+    return sum == static_cast<std::uint64_t>(n) * static_cast<std::uint64_t>(n - 1) / 2;
+}
+
+static void work(int iterations)
+{
+    for (int i = 0; i < iterations; ++i)
+    {
+        ASSERT_ABORT(i >= 0, "cheap");
+        ASSERT_ABORT(expensive(2000), "expensive");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back(work, 250);
+    for (auto &thread : threads)
+        thread.join();
+
+    const std::vector<assertify::profile_entry> entries = assertify::profile_snapshot();
+    ASSERT_ABORT(entries.size() == 2, "only evaluated sites are listed");
+    ASSERT_ABORT(std::strcmp(entries[0].site->expr_str, "expensive(2000)") == 0,
+                 "most expensive first");
+    ASSERT_ABORT(entries[0].calls == 1000 && entries[1].calls == 1000, "shards add up");
+    ASSERT_ABORT(entries[0].ticks > 10 * entries[1].ticks, "costs are told apart");
+
+    FILE *capture = std::tmpfile();
+    assertify::print_profile(1, fileno(capture));
+    std::string text(4096, '\0');
+    text.resize(static_cast<std::size_t>(pread(fileno(capture), text.data(), text.size(), 0)));
+    ASSERT_ABORT(text.rfind("Assertion profile:\ttop 1 of ", 0) == 0, "header");
+    ASSERT_ABORT(text.find("  test/test_profile.cpp:20  expensive(2000)\n") != std::string::npos,
+                 "table row");
+    ASSERT_ABORT(text.find("i >= 0") == std::string::npos, "only the top rows");
+}
@@ -0,0 +1,124 @@
+#include "assertify_test.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+ASSERTIFY_TEST(passes)
+{
+    ASSERT_ABORT(2 * 2 == 4, "arithmetic works");
+}
+
+ASSERTIFY_TEST(passes_with_output)
+{
+    std::printf("line <1> & \"2\"\n");
+}
+
+ASSERTIFY_TEST(fails_with_markup)
+{
+    std::fprintf(stderr, "tab\tquote\" <tag> & \x01\n");
+    throw std::runtime_error("1 < 2 && \"quoted\"");
+}
+
+// Many short tests finishing at once, from every worker
+#define SPIN_TEST(n)                         \
+    ASSERTIFY_TEST(spin_##n)                 \
+    {                                        \
+        volatile int sum = 0;                \
+        for (int i = 0; i < (n) * 1000; ++i) \
+            sum = sum + i;                   \
+    }
+SPIN_TEST(1)
+SPIN_TEST(2)
+SPIN_TEST(3)
+SPIN_TEST(4)
+SPIN_TEST(5)
+SPIN_TEST(6)
+SPIN_TEST(7)
+SPIN_TEST(8)
+SPIN_TEST(9)
+SPIN_TEST(10)
+SPIN_TEST(11)
+SPIN_TEST(12)
+SPIN_TEST(13)
+SPIN_TEST(14)
+SPIN_TEST(15)
+SPIN_TEST(16)
+
+static std::string slurp(const std::string &path)
+{
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+static std::size_t count(const std::string &text, const std::string &needle)
+{
+    std::size_t n = 0;
+    for (std::size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+        ++n;
+    return n;
+}
+
+static void check_reports(const std::string &prefix, bool threads)
+{
+    assertify::test_options opts;
+    opts.jobs = 8;
+    opts.threads = threads;
+    opts.suite_name = "test_reporting";
+    opts.junit_path = prefix + ".xml";
+    opts.tap_path = prefix + ".tap";
+    opts.jsonl_path = prefix + ".jsonl";
+    std::vector<assertify::test_result> results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    ASSERT_ABORT(results.size() == 19, "every test ran");
+
+    std::string tap = slurp(opts.tap_path);
+    ASSERT_ABORT(tap.rfind("TAP version 14\n1..19\n", 0) == 0, "TAP starts with its plan");
+    ASSERT_ABORT(count(tap, "\nok ") == 18 && count(tap, "\nnot ok ") == 1, "a TAP line per test");
+    for (int i = 1; i <= 19; ++i)
+        ASSERT_ABORT(tap.find(" " + std::to_string(i) + " - ") != std::string::npos,
+                     "TAP numbers follow the order tests finished in");
+    ASSERT_ABORT(tap.find(" - fails_with_markup # time=") < tap.find("  ---\n  message: \"") &&
+                     tap.find("  ...\n") != std::string::npos,
+                 "a failed test has a YAML block");
+
+    std::string jsonl = slurp(opts.jsonl_path);
+    ASSERT_ABORT(count(jsonl, "\n") == 19 && count(jsonl, "\"status\":\"passed\"") == 18,
+                 "a JSON line per test");
+    ASSERT_ABORT(jsonl.find("\\\"quoted\\\"") != std::string::npos, "JSON strings are escaped");
+
+    std::string xml = slurp(opts.junit_path);
+    ASSERT_ABORT(xml.find("<testsuite name=\"test_reporting\" tests=\"19\" failures=\"1\"") !=
+                     std::string::npos,
+                 "the JUnit suite carries the totals");
+    ASSERT_ABORT(count(xml, "<testcase ") == 19 && count(xml, "<failure ") == 1,
+                 "a JUnit test case per test");
+    ASSERT_ABORT(xml.find("1 &lt; 2 &amp;&amp; &quot;quoted&quot;") != std::string::npos,
+                 "JUnit text is escaped");
+    ASSERT_ABORT(xml.find('\x01') == std::string::npos, "control characters are dropped from XML");
+    if (!threads)
+        ASSERT_ABORT(xml.find("<system-out>line &lt;1&gt; &amp; &quot;2&quot;\n</system-out>") !=
+                         std::string::npos,
+                     "output of a forked test goes to system-out");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+    {
+        // Leave the reports for the schema checks in CMakeLists.txt
+        check_reports(argv[1], false);
+        return 0;
+    }
+    check_reports("test_reporting_processes", false);
+    check_reports("test_reporting_threads", true);
+    for (const char *prefix : {"test_reporting_processes", "test_reporting_threads"})
+    {
+        for (const char *ext : {".xml", ".tap", ".jsonl"})
+            std::remove((std::string(prefix) + ext).c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "assertify_test.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+constexpr const char *kCache = "test_rerun.testcache";
+constexpr const char *kFailMarker = "test_rerun.fail";
+
+ASSERTIFY_TEST(adds)
+{
+    ASSERT_ABORT(2 + 2 == 4, "adds");
+}
+
+ASSERTIFY_TEST(multiplies)
+{
+    ASSERT_ABORT(3 * 3 == 9, "multiplies");
+}
+
+ASSERTIFY_TEST(flaky)
+{
+    ASSERT_ABORT(!std::ifstream(kFailMarker).good(), "flaky fails while the marker exists");
+}
+
+static const assertify::test_case *test(const char *name)
+{
+    for (const assertify::test_case *t : assertify::registered_tests())
+    {
+        if (std::strcmp(t->name, name) == 0)
+            return t;
+    }
+    return nullptr;
+}
+
+static assertify::test_options options(bool only_changed, bool failed_first)
+{
+    assertify::test_options opts;
+    opts.cache_path = kCache;
+    opts.only_changed = only_changed;
+    opts.failed_first = failed_first;
+    return opts;
+}
+
+static std::vector<std::string> plan(const assertify::test_options &opts, std::size_t &unchanged)
+{
+    std::vector<std::string> names;
+    for (const assertify::test_case *t : assertify::plan_tests(opts, &unchanged))
+        names.push_back(t->name);
+    return names;
+}
+
+int main(int argc, char *argv[])
+{
+    std::remove(kCache);
+    std::ofstream(kFailMarker) << "fail\n";
+
+    // Each test hashes its own function, and the hashes are reproducible
+    std::uint64_t adds = assertify::detail::code_hash(*test("adds"));
+    ASSERT_ABORT(adds != 0 && adds != assertify::detail::code_hash(*test("multiplies")),
+                 "tests have distinct code hashes");
+    auto again = assertify::detail::hash_test_code();
+    ASSERT_ABORT(again[reinterpret_cast<std::uintptr_t>(test("adds")->fn)] == adds,
+                 "code hashes are reproducible");
+
+    std::size_t unchanged = 0;
+    assertify::test_options opts = options(false, false);
+    std::vector<assertify::test_result> results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    ASSERT_ABORT(results.size() == 3, "every test ran");
+    {
+        assertify::test_cache cache(kCache, 3);
+        const assertify::test_cache_entry *entry = cache.find("adds");
+        ASSERT_ABORT(entry != nullptr && entry->status == assertify::test_status::passed &&
+                         entry->runs == 1 && entry->code_hash == adds && entry->duration_ns > 0 &&
+                         std::strcmp(entry->name, "adds") == 0,
+                     "results are kept in the cache");
+        ASSERT_ABORT(cache.find("flaky")->status == assertify::test_status::failed,
+                     "failures are kept in the cache");
+    }
+
+    ASSERT_ABORT(plan(options(false, true), unchanged).front() == "flaky",
+                 "--failed-first runs the last failure first");
+    ASSERT_ABORT(plan(options(true, false), unchanged) == std::vector<std::string>({"flaky"}) &&
+                     unchanged == 2,
+                 "--only-changed skips unchanged passing tests");
+
+    // A different code hash stands for a rebuilt test
+    {
+        assertify::test_cache cache(kCache, 3);
+        cache.find("multiplies")->code_hash ^= 1;
+    }
+    std::vector<std::string> changed = plan(options(true, true), unchanged);
+    ASSERT_ABORT(changed == std::vector<std::string>({"flaky", "multiplies"}) && unchanged == 1,
+                 "--only-changed runs tests whose code changed");
+
+    std::remove(kFailMarker);
+    opts = options(true, true);
+    results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    ASSERT_ABORT(results.size() == 2 && results[0].passed && results[1].passed, "reruns pass");
+    ASSERT_ABORT(plan(options(true, false), unchanged).empty() && unchanged == 3,
+                 "nothing is left to rerun");
+
+    // Growing the table keeps the entries
+    {
+        assertify::test_cache cache(kCache, 1000);
+        const assertify::test_cache_entry *entry = cache.find("multiplies");
+        ASSERT_ABORT(entry != nullptr && entry->runs == 2 &&
+                         entry->status == assertify::test_status::passed,
+                     "entries survive a rebuild");
+        for (int i = 0; i < 1000; ++i)
+            ASSERT_ABORT(cache.insert(("generated_" + std::to_string(i)).c_str()) != nullptr,
+                         "the rebuilt table has room");
+    }
+    ASSERT_ABORT(plan(options(true, false), unchanged).empty() && unchanged == 3,
+                 "the rebuilt cache is reused");
+    std::remove(kCache);
+}
@@ -0,0 +1,151 @@
+#include "assertify_test.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+ASSERTIFY_TEST(pass_arithmetic)
+{
+    ASSERT_ABORT(1 + 1 == 2, "arithmetic works");
+}
+
+ASSERTIFY_TEST(pass_death)
+{
+    ASSERTIFY_EXPECT_DEATH(ASSERT_ABORT(false, "pass_death fires"), "pass_death fires");
+}
+
+ASSERTIFY_TEST(fail_abort)
+{
+    ASSERT_ABORT(false, "fail_abort fires");
+}
+
+ASSERTIFY_TEST(fail_throw)
+{
+    throw std::runtime_error("fail_throw throws");
+}
+
+ASSERTIFY_TEST(fail_death)
+{
+    ASSERTIFY_EXPECT_DEATH((void)0, "");
+}
+
+// sleep_N takes N * 25 ms, so sorted by name they run shortest first
+#define SLEEP_TEST(n)                                                     \
+    ASSERTIFY_TEST(sleep_##n)                                             \
+    {                                                                     \
+        std::this_thread::sleep_for(std::chrono::milliseconds(25 * (n))); \
+    }
+SLEEP_TEST(1)
+SLEEP_TEST(2)
+SLEEP_TEST(3)
+SLEEP_TEST(4)
+SLEEP_TEST(5)
+SLEEP_TEST(6)
+SLEEP_TEST(7)
+SLEEP_TEST(8)
+
+static std::vector<std::string> names(const std::vector<const assertify::test_case *> &tests)
+{
+    std::vector<std::string> result;
+    for (const assertify::test_case *test : tests)
+        result.push_back(test->name);
+    return result;
+}
+
+static assertify::test_options options(const char *filter, std::size_t jobs, bool threads)
+{
+    assertify::test_options opts;
+    opts.filter = filter;
+    opts.jobs = jobs;
+    opts.threads = threads;
+    opts.cache_path = "test_runner.testcache";
+    return opts;
+}
+
+static const assertify::test_result *find(const std::vector<assertify::test_result> &results,
+                                          const std::string &name)
+{
+    for (const assertify::test_result &r : results)
+    {
+        if (r.test->name == name)
+            return &r;
+    }
+    return nullptr;
+}
+
+static double run_sleeps(bool threads)
+{
+    assertify::test_options opts = options("sleep_*", 4, threads);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<assertify::test_result> results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    for (const assertify::test_result &r : results)
+        ASSERT_ABORT(r.passed, "sleep tests pass");
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::remove("test_runner.testcache");
+
+    // Registration, filters and shards
+    std::vector<std::string> all = names(assertify::registered_tests());
+    ASSERT_ABORT(all.size() == 13 && all.front() == "fail_abort" && all.back() == "sleep_8",
+                 "every test is registered, ordered by name");
+    ASSERT_ABORT(names(assertify::plan_tests(options("pass_*", 1, false))) ==
+                     std::vector<std::string>({"pass_arithmetic", "pass_death"}),
+                 "filter selects by glob");
+    ASSERT_ABORT(names(assertify::plan_tests(options("fail_*:-*_death:pass_?eath", 1, false))) ==
+                     std::vector<std::string>({"fail_abort", "fail_throw"}),
+                 "exclusions win over inclusions");
+    std::set<std::string> sharded;
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        assertify::test_options opts = options("", 1, false);
+        opts.shard_index = i;
+        opts.shard_count = 3;
+        std::vector<std::string> shard = names(assertify::plan_tests(opts));
+        ASSERT_ABORT(shard.size() >= 4 && shard.size() <= 5, "shards are balanced");
+        sharded.insert(shard.begin(), shard.end());
+    }
+    ASSERT_ABORT(sharded.size() == all.size(), "shards cover every test once");
+
+    // Failures are contained in their child and reported
+    assertify::test_options opts = options("fail_*:pass_*", 4, false);
+    std::vector<assertify::test_result> results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    ASSERT_ABORT(results.size() == 5, "all selected tests ran");
+    ASSERT_ABORT(find(results, "pass_arithmetic")->passed && find(results, "pass_death")->passed,
+                 "passing tests pass");
+    const assertify::test_result *aborted = find(results, "fail_abort");
+    ASSERT_ABORT(!aborted->passed && aborted->reason.find("signal 6") != std::string::npos &&
+                     aborted->output.find("fail_abort fires") != std::string::npos,
+                 "an abort fails its test with its report");
+    ASSERT_ABORT(!find(results, "fail_throw")->passed &&
+                     find(results, "fail_throw")->output.find("fail_throw throws") != std::string::npos,
+                 "an exception fails its test");
+    ASSERT_ABORT(!find(results, "fail_death")->passed, "a failed death test fails its test");
+
+    opts = options("fail_throw:fail_death:pass_*", 2, true);
+    results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    ASSERT_ABORT(results.size() == 4 && !find(results, "fail_throw")->passed &&
+                     find(results, "fail_throw")->reason == "threw: fail_throw throws" &&
+                     !find(results, "fail_death")->passed &&
+                     find(results, "fail_death")->reason == "1 failed check(s)" &&
+                     find(results, "pass_death")->passed,
+                 "failures are attributed to their test on the thread pool");
+
+    // 900 ms of sleeps on 4 workers; the first run has no durations yet
+    double serial = 25 * 36;
+    double first = run_sleeps(false);
+    std::vector<std::string> order = names(assertify::plan_tests(options("sleep_*", 4, false)));
+    ASSERT_ABORT(order.front() == "sleep_8" && order.back() == "sleep_1",
+                 "recorded durations order the tests longest first");
+    double processes = run_sleeps(false);
+    double threads = run_sleeps(true);
+    std::printf("serial %.0f ms, first run %.0f ms, longest first %.0f ms, threads %.0f ms\n", serial,
+                first, processes, threads);
+    ASSERT_ABORT(processes < serial / 2 && threads < serial / 2, "tests run in parallel");
+    std::remove("test_runner.testcache");
+}
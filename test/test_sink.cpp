@@ -0,0 +1,123 @@
+#include "assertify.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+
+static std::string read_all(FILE *file)
+{
+    std::string data;
+    char buf[4096];
+    ssize_t n;
+    lseek(fileno(file), 0, SEEK_SET);
+    while ((n = read(fileno(file), buf, sizeof(buf))) > 0)
+        data.append(buf, static_cast<std::size_t>(n));
+    return data;
+}
+
+static bool contains(const std::string &text, const char *needle)
+{
+    return text.find(needle) != std::string::npos;
+}
+
+static void check_json_lines()
+{
+    FILE *out = std::tmpfile();
+    assertify::set_sink(assertify::sink_format::json_lines, fileno(out));
+    int n = 3;
+    ASSERTIFY_CHECK(n == 4, "tab\tand \"quote\"");
+    for (int i = 0; i < 5; ++i)
+        ASSERTIFY_EXPECT(i < 0, "soft one");
+    ASSERT_ABORT(assertify::flush_expectations() == 1, "one soft site");
+    assertify::set_sink(assertify::sink_format::text);
+
+    std::string text = read_all(out);
+    ASSERT_ABORT(std::count(text.begin(), text.end(), '\n') == 2, "one line per record");
+    ASSERT_ABORT(contains(text, "{\"kind\":\"recoverable\",\"expr\":\"n == 4\","
+                                "\"file\":\"test/test_sink.cpp\",\"line\":"),
+                 "recoverable record");
+    ASSERT_ABORT(contains(text, "\"msg\":\"tab\\tand \\\"quote\\\"\",\"thread\":"), "escaping");
+    ASSERT_ABORT(contains(text, "{\"kind\":\"soft\",\"expr\":\"i < 0\""), "soft record");
+    ASSERT_ABORT(contains(text, "\"count\":5}\n"), "soft count");
+}
+
+static std::string json_string(const char *s, std::size_t budget)
+{
+    char buf[64];
+    assertify::detail::fixed_writer out(buf, sizeof(buf));
+    assertify::detail::append_json_string(out, s, budget);
+    return std::string(buf, out.finish());
+}
+
+static void check_json_utf8()
+{
+    ASSERT_ABORT(json_string("caf\xc3\xa9 \xf0\x9f\x98\x80", 64) == "\"caf\xc3\xa9 \xf0\x9f\x98\x80\"",
+                 "well-formed UTF-8 is kept");
+    ASSERT_ABORT(json_string("caf\xc3\xa9", 4) == "\"caf\"", "a sequence is not split at the budget");
+    ASSERT_ABORT(json_string("a\xff\xc3(b", 64) == "\"a\\ufffd\\ufffd(b\"", "stray bytes are replaced");
+    ASSERT_ABORT(json_string("\xc0\xaf\xed\xa0\x80", 64) ==
+                     "\"\\ufffd\\ufffd\\ufffd\\ufffd\\ufffd\"",
+                 "overlong forms and surrogates are replaced");
+}
+
+static void check_binary()
+{
+    FILE *out = std::tmpfile();
+    assertify::set_sink(assertify::sink_format::binary, fileno(out));
+    ASSERTIFY_CHECK(sizeof(int) == 3, "binary check");
+    for (int i = 0; i < 7; ++i)
+    {
+        ASSERTIFY_EXPECT(i < 0, "first soft");
+        ASSERTIFY_EXPECT(i > 100, "second soft");
+    }
+    assertify::flush_expectations();
+    assertify::set_sink(assertify::sink_format::text);
+
+    std::string data = read_all(out);
+    std::vector<assertify::binary_record> records;
+    for (std::size_t offset = 0; offset < data.size();)
+    {
+        assertify::binary_record record;
+        std::size_t size = assertify::decode_binary_record(data.data() + offset,
+                                                           data.size() - offset, record);
+        ASSERT_ABORT(size > 0, "stream decodes");
+        records.push_back(record);
+        offset += size;
+    }
+    ASSERT_ABORT(records.size() == 3, "three records");
+    ASSERT_ABORT(records[0].header.category == static_cast<std::uint8_t>(
+                                                   assertify::category::recoverable),
+                 "category");
+    ASSERT_ABORT(records[0].msg == "binary check" && records[0].header.count == 1, "check");
+    ASSERT_ABORT(records[0].header.thread_id == assertify::detail::thread_id(), "thread");
+    ASSERT_ABORT(records[1].expr_str == "i < 0" && records[1].header.count == 7, "first soft");
+    ASSERT_ABORT(records[2].msg == "second soft" && records[2].file == "test/test_sink.cpp",
+                 "second soft");
+}
+
+static void check_fatal_operands()
+{
+    FILE *out = std::tmpfile();
+    pid_t child = fork();
+    if (child == 0)
+    {
+        assertify::set_sink(assertify::sink_format::json_lines, fileno(out));
+        int n = 5;
+        ASSERTIFY_ASSERT_FMT(n < 0, "n is {}", n);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    std::string text = read_all(out);
+    ASSERT_ABORT(contains(text, "{\"kind\":\"fatal\",\"expr\":\"n < 0\""), "fatal record");
+    ASSERT_ABORT(contains(text, "\"msg\":\"n is 5\""), "formatted message");
+    ASSERT_ABORT(contains(text, "\"count\":1,\"operands\":\"05000000\"}"), "operands");
+}
+
+int main(int argc, char *argv[])
+{
+    check_json_lines();
+    check_json_utf8();
+    check_binary();
+    check_fatal_operands();
+}
@@ -0,0 +1,17 @@
+#include "assertify.hpp"
+
+#include <cstring>
+
+int main(int argc, char *argv[])
+{
+    // CMake defines ASSERTIFY_SOURCE_ROOT as the project directory
+    ASSERT_ABORT(std::strcmp(ASSERTIFY_FILE, "test/test_source_root.cpp") == 0,
+                 "source root is stripped from __FILE__");
+
+    static constexpr auto file = ASSERTIFY_STATIC_FILE;
+    static_assert(file.size() == sizeof("test/test_source_root.cpp") - 1,
+                  "trimming happens at compile time");
+
+    static_assert(assertify::detail::trimmed_path_size("/elsewhere/x.cpp") == 16,
+                  "paths outside the source root are kept");
+}
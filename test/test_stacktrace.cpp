@@ -0,0 +1,39 @@
+#define ASSERTIFY_STACKTRACE_ENABLED
+#include "assertify.hpp"
+
+#include <cstring>
+
+static void *s_frames[16];
+static std::size_t s_count;
+
+__attribute__((noinline)) void capture_leaf()
+{
+    s_count = assertify::detail::capture_stack(s_frames, 16, 0);
+    asm volatile("" ::: "memory");
+}
+
+__attribute__((noinline)) void fail_leaf(int x)
+{
+    ASSERT_ABORT(x == 0, "fail_leaf was asked to fail");
+    asm volatile("" ::: "memory");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && std::strcmp(argv[1], "fail") == 0)
+        fail_leaf(argc);
+
+    capture_leaf();
+    auto leaf = reinterpret_cast<std::uintptr_t>(&capture_leaf);
+    auto first = reinterpret_cast<std::uintptr_t>(s_frames[0]);
+    ASSERT_ABORT(s_count >= 2, "the stack has at least two frames");
+    ASSERT_ABORT(first > leaf && first < leaf + 256, "frame 0 is the caller of capture_stack");
+
+    assertify::detail::module_info module = assertify::detail::main_module();
+    ASSERT_ABORT(module.base <= leaf, "load base is below the code");
+
+    char text[512];
+    assertify::detail::format_stacktrace(text, sizeof(text), module, s_frames, 1);
+    ASSERT_ABORT(std::strncmp(text, "Stack trace:\tbuild-id ", 22) == 0, "trace header");
+    ASSERT_ABORT(std::strstr(text, "\n\t\t#0 0x") != nullptr, "first frame");
+}
@@ -0,0 +1,43 @@
+#include "assertify.hpp"
+
+#include <cstring>
+#include <string_view>
+
+// A literal-like message longer than the report buffer
+struct long_message
+{
+    char chars[ASSERTIFY_REPORT_BUFFER_SIZE + 200] = {};
+
+    constexpr long_message()
+    {
+        for (std::size_t i = 0; i + 1 < sizeof(chars); ++i)
+            chars[i] = 'x';
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    static constexpr auto report =
+        assertify::detail::make_report<42>("x must be positive", "x > 0",
+                                           assertify::detail::make_static_string("src/x.cpp"));
+    static constexpr char expected[] = "Assert failed:\tx must be positive\n"
+                                       "Expected:\tx > 0\n"
+                                       "Source:\t\tsrc/x.cpp, Line: 42\n";
+    static_assert(report.size() == sizeof(expected) - 1, "report is sized at compile time");
+    ASSERT_ABORT(std::memcmp(report.data(), expected, sizeof(expected)) == 0, "report contents");
+
+    // A message too long for the report buffer is shortened; the other lines stay
+    static constexpr long_message long_msg;
+    static constexpr auto long_report = assertify::detail::make_report<42>(
+        long_msg.chars, "x > 0", assertify::detail::make_static_string("src/x.cpp"));
+    static_assert(long_report.size() == ASSERTIFY_REPORT_BUFFER_SIZE, "report fills the buffer");
+    std::string_view shortened(long_report.data(), long_report.size());
+    ASSERT_ABORT(shortened.find("xxxx...\nExpected:\tx > 0\nSource:\t\tsrc/x.cpp, Line: 42\n") !=
+                     std::string_view::npos,
+                 "long message ends in ...");
+
+    static_assert(assertify::detail::to_static_string<0>().size() == 1, "single digit");
+    static_assert(assertify::detail::to_static_string<1000>().chars[3] == '0', "trailing zero");
+
+    ASSERTIFY_ASSERT_ABORT(argc > 0, "argc must be positive");
+}
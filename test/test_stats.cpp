@@ -0,0 +1,80 @@
+#define ASSERTIFY_STATS_ENABLED
+#include "assertify.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+
+static void check(int i)
+{
+    ASSERT_ABORT(i >= 0, "i is not negative");
+    ASSERTIFY_ASSERT_ABORT(i < 1000, "i is below 1000");
+}
+
+int main(int argc, char *argv[])
+{
+    for (int i = 0; i < 100; ++i)
+        check(i);
+
+    auto [begin, end] = assertify::stats_sites();
+    ASSERT_ABORT(end - begin >= 2, "sites are registered in the linker section");
+    for (auto *site = begin; site != end; ++site)
+    {
+        if (std::strcmp(site->expr_str, "i >= 0") == 0)
+            ASSERT_ABORT(site->passed.load() == 100 && site->failed.load() == 0, "counts");
+    }
+
+    const char *path = "test_stats.shm";
+    ASSERT_ABORT(assertify::start_stats_export(path, std::chrono::milliseconds(5)), "export");
+    for (int i = 0; i < 50; ++i)
+        check(i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    int fd = open(path, O_RDONLY);
+    void *map = mmap(nullptr, assertify::detail::stats_segment_size(end - begin), PROT_READ,
+                     MAP_SHARED, fd, 0);
+    ASSERT_ABORT(map != MAP_FAILED, "segment maps");
+    std::vector<assertify::stats_entry> entries;
+    auto *segment = static_cast<assertify::stats_header *>(map);
+    std::uint64_t updated_ns = 0;
+    ASSERT_ABORT(assertify::read_stats(segment, entries, &updated_ns) == assertify::stats_read::ok &&
+                     updated_ns != 0,
+                 "snapshot");
+    bool found = false;
+    for (const auto &entry : entries)
+    {
+        if (std::strcmp(entry.expr_str, "i < 1000") == 0)
+        {
+            found = true;
+            ASSERT_ABORT(entry.passed == 150, "live counts are published");
+            ASSERT_ABORT(std::strcmp(entry.file, "test/test_stats.cpp") == 0, "file");
+        }
+    }
+    ASSERT_ABORT(found, "site is exported");
+
+    // A segment left mid-update by an exporter that died reads as torn instead of hanging
+    std::size_t size = assertify::detail::stats_segment_size(end - begin);
+    std::vector<char> copy(static_cast<const char *>(map), static_cast<const char *>(map) + size);
+    auto *torn = reinterpret_cast<assertify::stats_header *>(copy.data());
+    torn->sequence.store(torn->sequence.load() | 1);
+    ASSERT_ABORT(assertify::read_stats(torn, entries, nullptr, 10) == assertify::stats_read::torn &&
+                     entries.size() == static_cast<std::size_t>(end - begin),
+                 "torn snapshot");
+    const char *torn_path = "test_stats_torn.shm";
+    FILE *file = std::fopen(torn_path, "wb");
+    std::fwrite(copy.data(), 1, copy.size(), file);
+    std::fclose(file);
+
+    if (const char *tool = std::getenv("ASSERTIFY_TOP"))
+    {
+        std::string top = std::string(tool) + " --once " + path;
+        ASSERT_ABORT(std::system(top.c_str()) == 0, "assertify-top reads the segment");
+        top = std::string(tool) + " --once " + torn_path;
+        ASSERT_ABORT(std::system(top.c_str()) == 0, "assertify-top reads a torn segment");
+    }
+    std::remove(torn_path);
+    // Returning with the export running stops it in the exporter's destructor
+}
@@ -0,0 +1,84 @@
+#define ASSERTIFY_TRACE_ENABLED
+#include "assertify_test.hpp"
+
+#include <string>
+
+static bool slow(int ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return true;
+}
+
+static void work()
+{
+    ASSERT_ABORT(slow(2), "slow check");
+    for (int i = 0; i < 1000; ++i)
+        ASSERT_ABORT(i >= 0, "fast check");
+}
+
+static void exit_tracing(const char *path)
+{
+    assertify::start_trace(path);
+    work();
+    std::exit(0);
+}
+
+static void fail_tracing(const char *path)
+{
+    assertify::start_trace(path);
+    ASSERTIFY_ASSERT_EXCEPTION(sizeof(int) == 3, "traced failure");
+}
+
+static std::size_t count(const std::string &text, const char *needle)
+{
+    std::size_t n = 0;
+    for (std::size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1))
+        ++n;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "test_trace.json";
+    work();
+    ASSERT_ABORT(assertify::start_trace(path, std::chrono::milliseconds(5)), "trace starts");
+    ASSERT_ABORT(!assertify::start_trace(path), "one trace at a time");
+
+    std::thread first(work), second(work);
+    work();
+    first.join();
+    second.join();
+    ASSERTIFY_CHECK(sizeof(int) == 3, "traced check");
+    ASSERTIFY_EXPECT(sizeof(int) == 3, "traced expectation");
+    assertify::flush_expectations();
+    assertify::stop_trace();
+    work();
+
+    FILE *file = std::fopen(path, "r");
+    std::string text(1 << 20, '\0');
+    text.resize(std::fread(text.data(), 1, text.size(), file));
+    std::fclose(file);
+
+    ASSERT_ABORT(text.front() == '[' && text.substr(text.size() - 3) == "\n]\n", "JSON array");
+    ASSERT_ABORT(count(text, "{\"name\":\"slow(2)\",\"cat\":\"assertify\",\"ph\":\"X\"") == 3,
+                 "slow evaluations on every thread are traced only while tracing");
+    ASSERT_ABORT(count(text, "\"file\":\"test/test_trace.cpp\",\"line\":14}") == 3, "site");
+    ASSERT_ABORT(count(text, "\"cat\":\"assertify.failure\"") == 2, "failure reports");
+    ASSERT_ABORT(count(text, "\"kind\":\"recoverable\"}") == 1, "check report");
+    ASSERT_ABORT(count(text, "\"kind\":\"soft\"}") == 1, "expectation report");
+    ASSERT_ABORT(assertify::trace_dropped() == 0, "nothing dropped");
+
+    // Exiting with the trace running completes the file instead of terminating
+    std::string exit_path = std::string(path) + ".exit";
+    ASSERTIFY_EXPECT_EXIT(exit_tracing(exit_path.c_str()), assertify::exited_with(0), "");
+    ASSERTIFY_EXPECT_EXIT(fail_tracing(exit_path.c_str()), assertify::exited_with(1), "traced failure");
+    file = std::fopen(exit_path.c_str(), "r");
+    text.assign(1 << 20, '\0');
+    text.resize(std::fread(text.data(), 1, text.size(), file));
+    std::fclose(file);
+    std::remove(exit_path.c_str());
+    ASSERT_ABORT(text.front() == '[' && text.substr(text.size() - 3) == "\n]\n" &&
+                     count(text, "\"kind\":\"fatal\"}") == 1,
+                 "a failure that exits completes the trace");
+    ASSERT_ABORT(assertify::test_failures() == 0, "the traced children exit cleanly");
+}
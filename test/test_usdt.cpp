@@ -0,0 +1,22 @@
+#define ASSERTIFY_USDT_ENABLED
+#include "assertify.hpp"
+
+#include <cstdio>
+
+static int g_failures = 0;
+
+static void count_failure(const assertify::failure_info &) { ++g_failures; }
+
+static void check(int i) { ASSERTIFY_CHECK(i >= 0, "probed check"); }
+
+int main(int argc, char *argv[])
+{
+    assertify::set_handler(assertify::category::recoverable, count_failure);
+    for (int i = -2; i < 3; ++i)
+        check(i);
+    ASSERT_ABORT(g_failures == 2, "probes do not change the result");
+
+    // The site ID carried by the probes of `check`, matched against
+    // `readelf -n` output by the assertify_usdt_notes test
+    std::printf("%u\n", assertify::detail::site_id("test/test_usdt.cpp", 10));
+}
@@ -0,0 +1,137 @@
+#include "assertify_test.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+ASSERTIFY_TEST_COUNT_ALLOCATIONS()
+
+ASSERTIFY_TEST(hangs)
+{
+    std::this_thread::sleep_for(std::chrono::seconds(30));
+}
+
+// The death test child hangs too and must go down with the test
+ASSERTIFY_TEST(hangs_in_death_test)
+{
+    ASSERTIFY_EXPECT_DEATH(std::this_thread::sleep_for(std::chrono::seconds(30)), "");
+}
+
+ASSERTIFY_TEST(hangs_briefly)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+}
+
+ASSERTIFY_TEST(quick_a)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+ASSERTIFY_TEST(quick_b)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+}
+
+ASSERTIFY_TEST(allocates)
+{
+    for (int i = 0; i < 1000; ++i)
+        std::make_unique<int>(i);
+}
+
+ASSERTIFY_TEST(grows_rss)
+{
+    std::vector<char> block(64 << 20, 1);
+    ASSERT_ABORT(block[12345] == 1, "the block is touched");
+}
+
+static std::vector<assertify::test_result> run(const char *filter, bool threads,
+                                               std::uint64_t timeout_ms, std::uint64_t max_rss_kb,
+                                               std::uint64_t max_allocations, double &elapsed_ms)
+{
+    assertify::test_options opts;
+    opts.filter = filter;
+    opts.jobs = 4;
+    opts.threads = threads;
+    opts.timeout_ms = timeout_ms;
+    opts.max_rss_kb = max_rss_kb;
+    opts.max_allocations = max_allocations;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<assertify::test_result> results = assertify::run_tests(assertify::plan_tests(opts), opts);
+    elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return results;
+}
+
+static const assertify::test_result &find(const std::vector<assertify::test_result> &results,
+                                          const char *name)
+{
+    for (const assertify::test_result &r : results)
+    {
+        if (std::strcmp(r.test->name, name) == 0)
+            return r;
+    }
+    ASSERT_ABORT(false, "test ran");
+    return results.front();
+}
+
+int main(int argc, char *argv[])
+{
+    double elapsed = 0;
+
+    // Hung children are killed at the deadline while the others finish
+    auto results = run("hangs:hangs_in_death_test:quick_*", false, 200, 0, 0, elapsed);
+    ASSERT_ABORT(elapsed < 2000, "hung children do not block the run");
+    for (const char *name : {"hangs", "hangs_in_death_test"})
+    {
+        const assertify::test_result &r = find(results, name);
+        ASSERT_ABORT(!r.passed && r.timed_out && r.reason == "timed out after 200 ms" &&
+                         r.duration_ns >= 200000000,
+                     "a hung child is reported with its run time");
+    }
+    ASSERT_ABORT(find(results, "quick_a").passed && find(results, "quick_b").passed,
+                 "the other tests pass");
+
+    // A hung worker thread is abandoned; the rest of the pool goes on
+    results = run("hangs_briefly:quick_*", true, 200, 0, 0, elapsed);
+    ASSERT_ABORT(elapsed < 1000, "a hung worker does not block the run");
+    ASSERT_ABORT(find(results, "hangs_briefly").timed_out && find(results, "quick_a").passed &&
+                     find(results, "quick_b").passed,
+                 "the hung test times out and the others pass");
+
+    // With a single worker, a replacement thread runs the tests queued behind the hung one
+    assertify::test_options single;
+    single.filter = "hangs_briefly:quick_*";
+    single.jobs = 1;
+    single.threads = true;
+    single.timeout_ms = 200;
+    results = assertify::run_tests(assertify::plan_tests(single), single);
+    ASSERT_ABORT(results.size() == 3 && find(results, "hangs_briefly").timed_out &&
+                     find(results, "quick_a").passed && find(results, "quick_b").passed,
+                 "tests queued behind an abandoned worker still run");
+
+    // Resource budgets, measured in the child and on the worker thread
+    results = run("allocates:grows_rss", false, 0, 0, 0, elapsed);
+    ASSERT_ABORT(find(results, "allocates").passed && find(results, "allocates").allocations >= 1000,
+                 "allocations are counted in the child");
+    ASSERT_ABORT(find(results, "grows_rss").passed && find(results, "grows_rss").peak_rss_kb >= 64 * 1024,
+                 "peak RSS is measured");
+    ASSERT_ABORT(find(results, "allocates").peak_rss_kb < 16 * 1024,
+                 "pages inherited at fork are not counted");
+
+    // The parent's own pages do not count against the budget either
+    std::vector<char> parent_block(64 << 20, 1);
+    results = run("allocates:grows_rss", false, 0, 32 * 1024, 100, elapsed);
+    ASSERT_ABORT(!find(results, "allocates").passed &&
+                     find(results, "allocates").reason.find("over the budget of 100") != std::string::npos,
+                 "the allocation budget fails a test");
+    ASSERT_ABORT(!find(results, "grows_rss").passed &&
+                     find(results, "grows_rss").reason.find("peak RSS") != std::string::npos,
+                 "the RSS budget fails a test");
+    ASSERT_ABORT(find(results, "allocates").reason.find("peak RSS") == std::string::npos && parent_block[0] == 1,
+                 "a test that grows little stays under the RSS budget");
+
+    results = run("allocates", true, 0, 0, 100, elapsed);
+    ASSERT_ABORT(!find(results, "allocates").passed && find(results, "allocates").allocations >= 1000,
+                 "allocations are counted on the worker thread");
+}
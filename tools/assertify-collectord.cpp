@@ -0,0 +1,182 @@
+/**
+ * @file assertify-collectord.cpp
+ *
+ * @brief
+ *  Local collector for the failure datagrams that processes send after
+ *  `assertify::connect_collector`. Failures are deduplicated by site and
+ *  stack hash; for each one the daemon keeps the total count, the count over
+ *  the last minute, the set of reporting processes and the latest message.
+ *  A summary is printed every `--interval` seconds and on exit.
+ *
+ *  usage: assertify-collectord [--socket PATH] [--interval S] [--exit-after N]
+ */
+
+#include "assertify.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <poll.h>
+#include <set>
+#include <string>
+
+namespace
+{
+    constexpr std::size_t window_seconds = 60;
+
+    /** Failures of one site reached through one call path. */
+    struct failure_group
+    {
+        std::string file;
+        int line = 0;
+        std::string expr_str;
+        std::string last_msg;
+        std::uint64_t total = 0;
+        std::uint64_t buckets[window_seconds] = {};
+        std::uint64_t last_second = 0;
+        std::set<std::uint32_t> pids;
+
+        void add(std::uint64_t second)
+        {
+            advance(second);
+            ++buckets[second % window_seconds];
+            ++total;
+        }
+
+        /** Clears the buckets that fell out of the window since the last update. */
+        void advance(std::uint64_t second)
+        {
+            if (second <= last_second)
+                return;
+            std::uint64_t stale = second - last_second;
+            for (std::uint64_t s = 1; s <= stale && s <= window_seconds; ++s)
+                buckets[(last_second + s) % window_seconds] = 0;
+            last_second = second;
+        }
+
+        std::uint64_t recent(std::uint64_t second)
+        {
+            advance(second);
+            std::uint64_t sum = 0;
+            for (std::uint64_t count : buckets)
+                sum += count;
+            return sum;
+        }
+    };
+
+    volatile std::sig_atomic_t s_stop = 0;
+
+    void on_signal(int) { s_stop = 1; }
+
+    std::uint64_t now_seconds() { return assertify::detail::realtime_ns() / 1000000000u; }
+
+    void print_summary(std::map<std::pair<std::uint32_t, std::uint64_t>, failure_group> &groups,
+                       const std::map<std::uint32_t, std::uint32_t> &dropped,
+                       std::uint64_t received)
+    {
+        std::uint64_t lost = 0;
+        for (const auto &entry : dropped)
+            lost += entry.second;
+
+        std::cout << "received " << received << " failure(s) in " << groups.size()
+                  << " group(s), " << lost << " dropped by senders\n";
+        std::cout << std::setw(10) << "total" << std::setw(10) << "last 60s" << std::setw(8)
+                  << "procs" << "  site\n";
+        std::uint64_t second = now_seconds();
+        for (auto &[key, group] : groups)
+        {
+            std::cout << std::setw(10) << group.total << std::setw(10) << group.recent(second)
+                      << std::setw(8) << group.pids.size() << "  " << group.file << ":"
+                      << group.line << " [" << std::hex << std::setw(8) << std::setfill('0')
+                      << key.first << "/" << std::setw(16) << key.second << std::dec
+                      << std::setfill(' ') << "]\n"
+                      << std::setw(30) << "" << group.expr_str << ": " << group.last_msg << "\n";
+        }
+        std::cout << std::flush;
+    }
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    std::string path = ASSERTIFY_COLLECTOR_SOCKET;
+    int interval = 10;
+    std::uint64_t exit_after = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc)
+            path = argv[++i];
+        else if (arg == "--interval" && i + 1 < argc)
+            interval = std::atoi(argv[++i]);
+        else if (arg == "--exit-after" && i + 1 < argc)
+            exit_after = std::strtoull(argv[++i], nullptr, 10);
+        else
+        {
+            std::cerr << "usage: " << argv[0]
+                      << " [--socket PATH] [--interval S] [--exit-after N]\n";
+            return 2;
+        }
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << path << ": socket path too long\n";
+        return 1;
+    }
+    path.copy(addr.sun_path, path.size());
+
+    int fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ::unlink(path.c_str());
+    if (fd < 0 || ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        std::cerr << path << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::map<std::pair<std::uint32_t, std::uint64_t>, failure_group> groups;
+    std::map<std::uint32_t, std::uint32_t> dropped;
+    std::uint64_t received = 0;
+    std::uint64_t next_summary = now_seconds() + static_cast<std::uint64_t>(interval);
+
+    while (!s_stop && (exit_after == 0 || received < exit_after))
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 1000) > 0)
+        {
+            char buf[assertify::collector_datagram_size];
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            assertify::collector_message message;
+            if (n > 0 && assertify::decode_collector_message(buf, static_cast<std::size_t>(n), message))
+            {
+                const assertify::collector_header &h = message.header;
+                failure_group &group = groups[{h.site_id, h.stack_hash}];
+                if (group.total == 0)
+                {
+                    group.file = message.file;
+                    group.line = h.line;
+                    group.expr_str = message.expr_str;
+                }
+                group.last_msg = message.msg;
+                group.pids.insert(h.pid);
+                group.add(h.timestamp_ns / 1000000000u);
+                dropped[h.pid] = h.dropped;
+                ++received;
+            }
+        }
+        if (interval > 0 && now_seconds() >= next_summary)
+        {
+            print_summary(groups, dropped, received);
+            next_summary = now_seconds() + static_cast<std::uint64_t>(interval);
+        }
+    }
+
+    print_summary(groups, dropped, received);
+    ::close(fd);
+    ::unlink(path.c_str());
+}
@@ -0,0 +1,99 @@
+/**
+ * @file assertify-ring.cpp
+ *
+ * @brief
+ *  Decodes a crash ring file written by `assertify::open_crash_ring` and
+ *  prints its records, oldest first, in the same layout as the failure
+ *  reports on stderr. Stack traces can be piped into
+ *  `tools/assertify-symbolize` together with the unstripped binary.
+ *
+ *  usage: assertify-ring FILE
+ */
+
+#include "assertify.hpp"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "usage: " << argv[0] << " FILE\n";
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const auto *header = reinterpret_cast<const assertify::crash_ring_header *>(data.data());
+    if (data.size() < sizeof(*header) ||
+        std::string_view(header->magic, 8) != std::string_view(assertify::crash_ring_magic, 8))
+    {
+        std::cerr << argv[1] << ": not an assertify crash ring\n";
+        return 1;
+    }
+    if (header->version != assertify::crash_ring_version ||
+        header->record_size != sizeof(assertify::crash_record) ||
+        data.size() < sizeof(*header) + std::size_t{header->capacity} * header->record_size)
+    {
+        std::cerr << argv[1] << ": unsupported version " << header->version << "\n";
+        return 1;
+    }
+
+    const auto *records = reinterpret_cast<const assertify::crash_record *>(header + 1);
+    std::uint64_t next = header->next.load();
+    std::uint64_t first = next > header->capacity ? next - header->capacity : 0;
+
+    assertify::detail::module_info module;
+    module.base = header->load_base;
+    module.build_id_size = header->build_id_size;
+    for (std::size_t i = 0; i < header->build_id_size && i < sizeof(module.build_id); ++i)
+        module.build_id[i] = header->build_id[i];
+
+    std::cout << "pid " << header->pid << ", " << next << " failure(s) recorded\n";
+    for (std::uint64_t position = first; position < next; ++position)
+    {
+        const assertify::crash_record &rec = records[position % header->capacity];
+        if (rec.sequence.load() != position + 1)
+        {
+            std::cout << "\n#" << position << " incomplete\n";
+            continue;
+        }
+
+        std::time_t seconds = static_cast<std::time_t>(rec.timestamp_ns / 1000000000u);
+        char when[32];
+        std::strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", std::gmtime(&seconds));
+        std::cout << "\n#" << position << " " << when << "." << std::setw(9)
+                  << std::setfill('0') << rec.timestamp_ns % 1000000000u << "Z thread "
+                  << rec.thread_id << " site " << std::hex << std::setw(8) << rec.site_id
+                  << std::dec << std::setfill(' ') << "\n";
+
+        char report[ASSERTIFY_REPORT_BUFFER_SIZE];
+        assertify::detail::failure f{rec.expr_str, rec.file, rec.line, rec.msg};
+        std::cout.write(report, static_cast<std::streamsize>(assertify::detail::format_report(
+                                    report, sizeof(report), "Assert failed:\t", f)));
+
+        if (rec.operand_size > 0)
+        {
+            std::cout << "Operands:\t";
+            static constexpr char digits[] = "0123456789abcdef";
+            for (std::uint32_t i = 0; i < rec.operand_size && i < sizeof(rec.operands); ++i)
+                std::cout << digits[rec.operands[i] >> 4] << digits[rec.operands[i] & 0xf];
+            std::cout << "\n";
+        }
+
+        void *frames[16];
+        std::size_t count = rec.frame_count < 16 ? rec.frame_count : 16;
+        for (std::size_t i = 0; i < count; ++i)
+            frames[i] = reinterpret_cast<void *>(static_cast<std::uintptr_t>(rec.frames[i]));
+        if (count > 0)
+        {
+            char text[64 + 16 * 32];
+            std::cout.write(text, static_cast<std::streamsize>(assertify::detail::format_stacktrace(
+                                      text, sizeof(text), module, frames, count)));
+        }
+    }
+}
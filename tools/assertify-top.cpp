@@ -0,0 +1,173 @@
+/**
+ * @file assertify-top.cpp
+ *
+ * @brief
+ *  Live view of the per-site assertion counters that a process publishes with
+ *  `assertify::start_stats_export`. The segment is read with plain loads
+ *  through a read-only mapping, so the observed process is never stopped or
+ *  slowed down.
+ *
+ *  usage: assertify-top [--once] [--interval MS] [-n N] PID|FILE
+ */
+
+#include "assertify.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    struct options
+    {
+        bool once = false;
+        int interval_ms = 1000;
+        std::size_t rows = 10;
+        std::string path;
+    };
+
+    const assertify::stats_header *map_segment(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return nullptr;
+        assertify::stats_header header;
+        ssize_t n = ::pread(fd, &header, sizeof(header), 0);
+        void *map = MAP_FAILED;
+        if (n == static_cast<ssize_t>(sizeof(header)))
+            map = ::mmap(nullptr, assertify::detail::stats_segment_size(header.count), PROT_READ,
+                         MAP_SHARED, fd, 0);
+        ::close(fd);
+        return map == MAP_FAILED ? nullptr : static_cast<const assertify::stats_header *>(map);
+    }
+
+    std::string location(const assertify::stats_entry &entry)
+    {
+        return std::string(entry.file) + ":" + std::to_string(entry.line);
+    }
+
+    std::string age(std::uint64_t now_ns, std::uint64_t then_ns)
+    {
+        if (then_ns == 0)
+            return "-";
+        double seconds = static_cast<double>(now_ns - then_ns) / 1e9;
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << seconds << "s ago";
+        return out.str();
+    }
+
+    void render(const assertify::stats_header *segment, assertify::stats_read status,
+                std::uint64_t updated_ns, const std::vector<assertify::stats_entry> &entries,
+                const std::unordered_map<std::uint32_t, assertify::stats_entry> &previous,
+                double elapsed, const options &opts)
+    {
+        struct row
+        {
+            const assertify::stats_entry *entry;
+            double rate;
+        };
+        std::vector<row> rows;
+        std::uint64_t total_passed = 0, total_failed = 0;
+        for (const auto &entry : entries)
+        {
+            std::uint64_t calls = entry.passed + entry.failed;
+            auto it = previous.find(entry.site_id);
+            if (it != previous.end())
+                calls -= it->second.passed + it->second.failed;
+            rows.push_back({&entry, elapsed > 0 ? static_cast<double>(calls) / elapsed
+                                                : static_cast<double>(calls)});
+            total_passed += entry.passed;
+            total_failed += entry.failed;
+        }
+
+        std::cout << "pid " << segment->pid << "  sites " << entries.size() << "  passed "
+                  << total_passed << "  failed " << total_failed
+                  << (status == assertify::stats_read::torn ? "  (torn: exporter stopped mid-update)"
+                                                            : "")
+                  << "\n\n";
+
+        std::sort(rows.begin(), rows.end(),
+                  [](const row &a, const row &b) { return a.rate > b.rate; });
+        std::cout << (elapsed > 0 ? "HOTTEST (checks/s)\n" : "HOTTEST (checks)\n");
+        std::cout << std::setw(14) << "rate" << std::setw(14) << "passed" << std::setw(10)
+                  << "failed" << "  site\n";
+        for (std::size_t i = 0; i < rows.size() && i < opts.rows; ++i)
+        {
+            const auto &e = *rows[i].entry;
+            std::cout << std::setw(14) << std::fixed << std::setprecision(0) << rows[i].rate
+                      << std::setw(14) << e.passed << std::setw(10) << e.failed << "  "
+                      << location(e) << "  " << e.expr_str << "\n";
+        }
+
+        std::sort(rows.begin(), rows.end(), [](const row &a, const row &b) {
+            return a.entry->last_failure_ns > b.entry->last_failure_ns;
+        });
+        std::cout << "\nRECENTLY FAILING\n";
+        for (std::size_t i = 0; i < rows.size() && i < opts.rows; ++i)
+        {
+            const auto &e = *rows[i].entry;
+            if (e.failed == 0)
+                break;
+            std::cout << std::setw(14) << age(updated_ns, e.last_failure_ns)
+                      << std::setw(10) << e.failed << "  " << location(e) << "  " << e.expr_str
+                      << "\n";
+        }
+    }
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    options opts;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--once")
+            opts.once = true;
+        else if (arg == "--interval" && i + 1 < argc)
+            opts.interval_ms = std::atoi(argv[++i]);
+        else if (arg == "-n" && i + 1 < argc)
+            opts.rows = static_cast<std::size_t>(std::atoi(argv[++i]));
+        else
+            opts.path = arg;
+    }
+    if (opts.path.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " [--once] [--interval MS] [-n N] PID|FILE\n";
+        return 2;
+    }
+    if (opts.path.find_first_not_of("0123456789") == std::string::npos)
+        opts.path = "/dev/shm/assertify-stats." + opts.path;
+
+    const assertify::stats_header *segment = map_segment(opts.path);
+    std::vector<assertify::stats_entry> entries;
+    if (segment == nullptr || assertify::read_stats(segment, entries) == assertify::stats_read::invalid)
+    {
+        std::cerr << opts.path << ": not an assertify statistics segment\n";
+        return 1;
+    }
+
+    std::unordered_map<std::uint32_t, assertify::stats_entry> previous;
+    std::uint64_t previous_ns = 0;
+    for (;;)
+    {
+        std::uint64_t updated_ns = 0;
+        assertify::stats_read status = assertify::read_stats(segment, entries, &updated_ns);
+        double elapsed = previous_ns == 0 ? 0 : (updated_ns - previous_ns) / 1e9;
+        if (!opts.once)
+            std::cout << "\033[H\033[2J";
+        render(segment, status, updated_ns, entries, previous, elapsed, opts);
+        std::cout << std::flush;
+        if (opts.once)
+            return 0;
+
+        previous.clear();
+        for (const auto &entry : entries)
+            previous[entry.site_id] = entry;
+        previous_ns = updated_ns;
+        std::this_thread::sleep_for(std::chrono::milliseconds(opts.interval_ms));
+    }
+}
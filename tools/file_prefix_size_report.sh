@@ -0,0 +1,69 @@
+#!/bin/sh
+# Measures how much .rodata ASSERTIFY_SOURCE_ROOT saves on a large binary.
+#
+# Generates FILES translation units, each with SITES assertion sites, in a deep
+# directory that mimics a CI checkout, then links them twice: once with full
+# __FILE__ paths and once with the source root stripped at compile time.
+#
+# usage: tools/file_prefix_size_report.sh [FILES] [SITES] [CXX]
+
+set -eu
+
+files=${1:-150}
+sites=${2:-20}
+cxx=${3:-${CXX:-c++}}
+include_dir=$(cd "$(dirname "$0")/../include" && pwd)
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+root="$work/home/ci-runner/builds/workspace/assertify-nightly/checkout/project"
+src="$root/src/services/storage/engine"
+mkdir -p "$src"
+
+i=0
+while [ "$i" -lt "$files" ]; do
+    {
+        echo '#include "assertify.hpp"'
+        s=0
+        while [ "$s" -lt "$sites" ]; do
+            echo "int f_${i}_${s}(int x) {"
+            echo "    ASSERT_ABORT(x != $s, \"x must not be $s\");"
+            echo "    ASSERTIFY_ASSERT_ABORT(x > $s, \"x must exceed $s\");"
+            echo "    return x + $s;"
+            echo "}"
+            s=$((s + 1))
+        done
+    } > "$src/module_$i.cpp"
+    i=$((i + 1))
+done
+echo 'int main() { return 0; }' > "$src/main.cpp"
+
+build() {
+    out=$1
+    shift
+    objs=
+    for f in "$src"/*.cpp; do
+        o="$work/$(basename "$f" .cpp).$out.o"
+        "$cxx" -std=c++20 -O2 -c -I"$include_dir" "$@" "$f" -o "$o"
+        objs="$objs $o"
+    done
+    # shellcheck disable=SC2086
+    "$cxx" $objs -o "$work/$out"
+}
+
+rodata() {
+    size -A "$1" | awk '$1 == ".rodata" { print $2 }'
+}
+
+build full
+build trimmed "-DASSERTIFY_SOURCE_ROOT=\"$root/\""
+
+full=$(rodata "$work/full")
+trimmed=$(rodata "$work/trimmed")
+
+echo "translation units:     $files"
+echo "sites per unit:        $((sites * 2))"
+echo "__FILE__ length:       $(printf '%s' "$src/module_0.cpp" | wc -c)"
+echo ".rodata, full paths:   $full bytes"
+echo ".rodata, trimmed:      $trimmed bytes"
+echo "saved:                 $((full - trimmed)) bytes ($(((full - trimmed) * 100 / full))%)"